@@ -0,0 +1,89 @@
+#pragma once
+
+#include "draw.h"
+#include <algorithm>
+#include <span>
+#include <vector>
+
+using namespace std;
+
+// Таблица длины дуги составной кривой Безье третьего порядка (для одной кривой — 4 опорные точки).
+// Параметр t составной кривой лежит в [0, число кривых]: целая часть — номер кривой, дробная — t внутри нее.
+// Длины накоплены по ломаной из samples равномерных по t точек каждой кривой, посчитанных bezier_point_3,
+// поэтому переход от расстояния к t — двоичный поиск, а от t к расстоянию — индекс в таблице.
+class ArcLengthTable {
+private:
+    vector<Point<double>> curve_points;
+    vector<double> lengths; // lengths[i] — длина дуги до t = i / samples
+    size_t samples = 1;
+
+    Point<double> segment_point(size_t segment, double t) const {
+        return bezier_point_3(span<const Point<double>>(curve_points.data() + 3 * segment, 4), t);
+    }
+
+public:
+    ArcLengthTable() = default;
+
+    explicit ArcLengthTable(const vector<Point<int>> &init_points, size_t samples_per_curve = 256)
+            : samples(max<size_t>(samples_per_curve, 1)) {
+        if (init_points.size() < 4 || (init_points.size() - 1) % 3 != 0)
+            throw runtime_error("Wrong number of init_points");
+
+        curve_points.resize(init_points.size());
+        for (size_t i = 0; i < init_points.size(); i++)
+            curve_points[i] = to_double_point(init_points[i]);
+
+        size_t n = segments() * samples;
+        lengths.resize(n + 1);
+        lengths[0] = 0;
+        Point<double> last = curve_points[0];
+        for (size_t i = 1; i <= n; i++) {
+            Point<double> cur = point_at(double(i) / samples);
+            lengths[i] = lengths[i - 1] + sqrt((cur - last).mod2());
+            last = cur;
+        }
+    }
+
+    size_t segments() const {
+        return curve_points.empty() ? 0 : (curve_points.size() - 1) / 3;
+    }
+
+    double length() const {
+        return lengths.empty() ? 0 : lengths.back();
+    }
+
+    Point<double> point_at(double t) const {
+        if (curve_points.empty())
+            return {};
+        t = clamp(t, 0.0, double(segments()));
+        size_t segment = min(size_t(t), segments() - 1);
+        return segment_point(segment, t - segment);
+    }
+
+    // расстояние вдоль кривой от начала до параметра t
+    double distance_at(double t) const {
+        if (lengths.empty())
+            return 0;
+        double pos = clamp(t, 0.0, double(segments())) * samples;
+        size_t i = min(size_t(pos), lengths.size() - 2);
+        return lengths[i] + (lengths[i + 1] - lengths[i]) * (pos - i);
+    }
+
+    // параметр t точки на расстоянии distance от начала кривой
+    double t_at(double distance) const {
+        if (lengths.empty())
+            return 0;
+        if (distance <= 0)
+            return 0;
+        if (distance >= length())
+            return double(segments());
+        size_t i = upper_bound(lengths.begin(), lengths.end(), distance) - lengths.begin() - 1;
+        double piece = lengths[i + 1] - lengths[i];
+        double fraction = piece > 0 ? (distance - lengths[i]) / piece : 0;
+        return (i + fraction) / samples;
+    }
+
+    Point<double> point_at_distance(double distance) const {
+        return point_at(t_at(distance));
+    }
+};
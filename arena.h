@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Монотонная арена: память выдается сдвигом указателя внутри блоков, освобождение ничего не делает.
+// reset() и rewind() возвращают память для повторного использования, не отдавая блоки обратно,
+// поэтому цикл с одинаковой нагрузкой после первой итерации не обращается к куче
+class Arena : public pmr::memory_resource {
+private:
+    struct Block {
+        byte *data;
+        size_t size;
+    };
+
+    pmr::memory_resource *upstream;
+    vector<Block> blocks;
+    size_t current = 0, offset = 0;
+    size_t next_block_size;
+    size_t upstream_allocations = 0;
+
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        for (; current < blocks.size(); current++, offset = 0) {
+            Block &block = blocks[current];
+            size_t address = reinterpret_cast<size_t>(block.data) + offset;
+            size_t aligned = (address + alignment - 1) / alignment * alignment - reinterpret_cast<size_t>(block.data);
+            if (aligned + bytes <= block.size) {
+                offset = aligned + bytes;
+                return block.data + aligned;
+            }
+        }
+
+        size_t size = max(next_block_size, bytes + alignment);
+        blocks.push_back({static_cast<byte *>(upstream->allocate(size, alignof(max_align_t))), size});
+        upstream_allocations++;
+        next_block_size = 2 * size;
+        current = blocks.size() - 1;
+        offset = 0;
+        return do_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(const pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit Arena(size_t initial_size = 64 * 1024, pmr::memory_resource *upstream = pmr::get_default_resource())
+            : upstream(upstream), next_block_size(initial_size) {}
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    // Все выделенное ранее становится недействительным
+    void reset() {
+        current = offset = 0;
+    }
+
+    pair<size_t, size_t> mark() const {
+        return {current, offset};
+    }
+
+    // Освобождение всего, что выделено после mark
+    void rewind(const pair<size_t, size_t> &position) {
+        current = position.first;
+        offset = position.second;
+    }
+
+    // Число блоков, взятых у вышестоящего ресурса за все время
+    size_t allocation_count() const {
+        return upstream_allocations;
+    }
+
+    ~Arena() override {
+        for (auto &block: blocks)
+            upstream->deallocate(block.data, block.size, alignof(max_align_t));
+    }
+};
+
+// Временная память текущего потока, освобождается при выходе из области видимости
+class ArenaScope {
+private:
+    Arena &arena;
+    pair<size_t, size_t> position;
+
+public:
+    explicit ArenaScope(Arena &arena) : arena(arena), position(arena.mark()) {}
+
+    ArenaScope(const ArenaScope &) = delete;
+
+    ~ArenaScope() {
+        arena.rewind(position);
+    }
+};
+
+// Арена для временных данных алгоритмов (например, отсечения) в текущем потоке
+inline Arena &scratch_arena() {
+    static thread_local Arena arena;
+    return arena;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <Magick++.h>
+
+using namespace std;
+
+enum class BlendMode {
+    SourceOver,
+    Additive,
+    Multiply,
+};
+
+// Пиксель RGBA с предумноженной на альфу яркостью, канал uint8_t или uint16_t
+template<typename C>
+struct Rgba {
+    C r = 0, g = 0, b = 0, a = 0;
+};
+
+using Rgba8 = Rgba<uint8_t>;
+using Rgba16 = Rgba<uint16_t>;
+
+template<typename C>
+constexpr uint32_t channel_max = numeric_limits<C>::max();
+
+// деление на максимум канала с округлением, для констант компилятор заменяет его умножением
+template<typename C>
+inline uint32_t div_max(uint32_t v) {
+    return (v + channel_max<C> / 2) / channel_max<C>;
+}
+
+template<typename C>
+Rgba<C> to_premultiplied(const Magick::Color &color) {
+    double k = channel_max<C> / double(QuantumRange);
+    double alpha = clamp(color.quantumAlpha() * k, 0.0, double(channel_max<C>));
+    double scale = alpha / channel_max<C>;
+    auto channel = [&](double v) { return C(lround(clamp(v * k, 0.0, double(channel_max<C>)) * scale)); };
+    return {channel(color.quantumRed()), channel(color.quantumGreen()), channel(color.quantumBlue()), C(lround(alpha))};
+}
+
+template<typename C>
+Magick::Color from_premultiplied(const Rgba<C> &p) {
+    double k = double(QuantumRange) / channel_max<C>;
+    double scale = p.a ? double(channel_max<C>) / p.a : 0;
+    return Magick::Color(Magick::Quantum(p.r * scale * k), Magick::Quantum(p.g * scale * k),
+                         Magick::Quantum(p.b * scale * k), Magick::Quantum(p.a * k));
+}
+
+// Ядра смешивания отрезка dst[0..n) с одним цветом src, уже умноженным на покрытие.
+// Каждый пиксель считается по четырем полям без ветвлений, в Release (-O3) GCC векторизует все три цикла
+template<typename C>
+void blend_span(Rgba<C> *dst, size_t n, Rgba<C> src, uint8_t coverage, BlendMode mode) {
+    if (coverage != 255) {
+        src.r = C((src.r * coverage + 127) / 255);
+        src.g = C((src.g * coverage + 127) / 255);
+        src.b = C((src.b * coverage + 127) / 255);
+        src.a = C((src.a * coverage + 127) / 255);
+    }
+
+    const uint32_t inv_a = channel_max<C> - src.a;
+    switch (mode) {
+        case BlendMode::SourceOver:
+            for (size_t i = 0; i < n; i++) {
+                Rgba<C> &d = dst[i];
+                d.r = C(src.r + div_max<C>(d.r * inv_a));
+                d.g = C(src.g + div_max<C>(d.g * inv_a));
+                d.b = C(src.b + div_max<C>(d.b * inv_a));
+                d.a = C(src.a + div_max<C>(d.a * inv_a));
+            }
+            break;
+        case BlendMode::Additive:
+            for (size_t i = 0; i < n; i++) {
+                Rgba<C> &d = dst[i];
+                d.r = C(min(uint32_t(src.r) + d.r, channel_max<C>));
+                d.g = C(min(uint32_t(src.g) + d.g, channel_max<C>));
+                d.b = C(min(uint32_t(src.b) + d.b, channel_max<C>));
+                d.a = C(min(uint32_t(src.a) + d.a, channel_max<C>));
+            }
+            break;
+        case BlendMode::Multiply:
+            // s * d + s * (1 - d_a) + d * (1 - s_a), для альфы получается обычное s_a + d_a - s_a * d_a
+            for (size_t i = 0; i < n; i++) {
+                Rgba<C> &d = dst[i];
+                uint32_t inv_da = channel_max<C> - d.a;
+                auto multiply = [&](uint32_t s, uint32_t v) {
+                    return C(min(div_max<C>(s * v) + div_max<C>(s * inv_da) + div_max<C>(v * inv_a), channel_max<C>));
+                };
+                d.r = multiply(src.r, d.r);
+                d.g = multiply(src.g, d.g);
+                d.b = multiply(src.b, d.b);
+                d.a = multiply(src.a, d.a);
+            }
+            break;
+    }
+}
+
+// Смешивание прямоугольника width x height изображения с левым верхним углом (x, y):
+// пиксели читаются из кэша пикселей изображения в буфер Rgba16, смешиваются ядром и записываются обратно
+void blend_region(Magick::Image &img, int x, int y, size_t width, size_t height, const Magick::Color &color,
+                  uint8_t coverage, BlendMode mode) {
+    size_t n = width * height;
+    Rgba16 src = to_premultiplied<uint16_t>(color);
+    static thread_local vector<Rgba16> buffer;
+    buffer.resize(n);
+
+    size_t channels = img.channels();
+    if (channels < 3) {
+        for (size_t i = 0; i < n; i++)
+            buffer[i] = to_premultiplied<uint16_t>(img.pixelColor(x + i % width, y + i / width));
+        blend_span(buffer.data(), n, src, coverage, mode);
+        for (size_t i = 0; i < n; i++)
+            img.pixelColor(x + i % width, y + i / width, from_premultiplied(buffer[i]));
+        return;
+    }
+
+    bool has_alpha = img.alpha();
+    const double k = 65535.0 / QuantumRange;
+    auto to_channel = [&](double v) { return uint16_t(clamp(v * k, 0.0, 65535.0) + 0.5); };
+
+    img.modifyImage();
+    Magick::Quantum *q = img.getPixels(x, y, width, height);
+    for (size_t i = 0; i < n; i++) {
+        const Magick::Quantum *p = q + i * channels;
+        uint32_t a = has_alpha ? to_channel(p[3]) : 65535;
+        buffer[i] = {uint16_t(div_max<uint16_t>(to_channel(p[0]) * a)),
+                     uint16_t(div_max<uint16_t>(to_channel(p[1]) * a)),
+                     uint16_t(div_max<uint16_t>(to_channel(p[2]) * a)),
+                     uint16_t(a)};
+    }
+
+    blend_span(buffer.data(), n, src, coverage, mode);
+
+    for (size_t i = 0; i < n; i++) {
+        Magick::Quantum *p = q + i * channels;
+        const Rgba16 &c = buffer[i];
+        double scale = c.a ? QuantumRange / double(c.a) : 0;
+        p[0] = Magick::Quantum(c.r * scale);
+        p[1] = Magick::Quantum(c.g * scale);
+        p[2] = Magick::Quantum(c.b * scale);
+        if (has_alpha)
+            p[3] = Magick::Quantum(c.a / k);
+    }
+    img.syncPixels();
+}
+
+// Смешивание отрезка [x_begin, x_end) строки y изображения
+void blend_span(Magick::Image &img, int y, int x_begin, int x_end, const Magick::Color &color,
+                uint8_t coverage, BlendMode mode) {
+    blend_region(img, x_begin, y, x_end - x_begin, 1, color, coverage, mode);
+}
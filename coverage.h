@@ -0,0 +1,147 @@
+#pragma once
+
+#include "draw.h"
+
+// Накопитель покрытия для сглаженной заливки, как в растеризаторах шрифтов.
+// Каждое ребро раскладывается по ячейкам-пикселям: cover — вертикальная протяженность ребра внутри ячейки,
+// area — ее часть, лежащая в самой ячейке. Ячейки хранятся разреженно по строкам,
+// покрытие пикселя получается префиксной суммой cover слева плюс area его ячейки
+class CoverageAccumulator {
+private:
+    struct Cell {
+        int x;
+        double cover;
+        double area;
+    };
+
+    int x_begin = 0, x_end = 0;
+    int y_begin = 0, y_end = 0;
+    vector<vector<Cell>> rows;
+
+    void add_cell(int x, int y, double cover, double x_mid) {
+        if (x >= x_end)
+            return;
+        // ячейки левее изображения нужны только для префиксной суммы, их можно слить в одну
+        if (x < x_begin)
+            x = x_begin - 1;
+        rows[y - y_begin].push_back({x, cover, cover * (1 - x_mid)});
+    }
+
+    // отрезок внутри строки y, dir — знак направления исходного ребра по y
+    void add_row_segment(int y, double xa, double ya, double xb, double yb, double dir) {
+        if (xa > xb) {
+            swap(xa, xb);
+            swap(ya, yb);
+        }
+        // часть левее изображения дает только cover, он целиком уходит в ячейку x_begin - 1,
+        // часть правее изображения не влияет на видимые пиксели
+        double left = x_begin, right = x_end;
+        if (xb <= left) {
+            add_cell(x_begin - 1, y, dir * abs(yb - ya), 0);
+            return;
+        }
+        if (xa >= right)
+            return;
+        if (xa < left) {
+            double y_left = ya + (left - xa) * (yb - ya) / (xb - xa);
+            add_cell(x_begin - 1, y, dir * abs(y_left - ya), 0);
+            xa = left;
+            ya = y_left;
+        }
+        if (xb > right) {
+            yb = ya + (right - xa) * (yb - ya) / (xb - xa);
+            xb = right;
+        }
+
+        int i_from = int(floor(xa)), i_to = int(floor(xb));
+        if (i_from == i_to) {
+            add_cell(i_from, y, dir * abs(yb - ya), (xa + xb) / 2 - i_from);
+            return;
+        }
+
+        double slope = (yb - ya) / (xb - xa);
+        double x = xa, y_cur = ya;
+        for (int i = i_from; i <= i_to && i < x_end; i++) {
+            double x_next = min(xb, double(i + 1));
+            double y_next = ya + (x_next - xa) * slope;
+            if (x_next > x)
+                add_cell(i, y, dir * abs(y_next - y_cur), (x + x_next) / 2 - i);
+            x = x_next;
+            y_cur = y_next;
+        }
+    }
+
+    static double resolve_coverage(double winding, bool even_odd) {
+        winding = abs(winding);
+        if (!even_odd)
+            return min(winding, 1.0);
+        winding = fmod(winding, 2.0);
+        return winding > 1 ? 2 - winding : winding;
+    }
+
+public:
+    CoverageAccumulator() = default;
+
+    // Рабочая область [x_begin, x_end) x [y_begin, y_end); память строк переиспользуется между вызовами
+    void reset(int _x_begin, int _x_end, int _y_begin, int _y_end) {
+        x_begin = _x_begin;
+        x_end = _x_end;
+        y_begin = _y_begin;
+        y_end = max(_y_begin, _y_end);
+        for (auto &row: rows)
+            row.clear();
+        if (rows.size() < size_t(y_end - y_begin))
+            rows.resize(y_end - y_begin);
+    }
+
+    // Ребро в координатах ячеек: ячейка x занимает [x, x + 1)
+    void add_line(Point<double> a, Point<double> b) {
+        if (a.y == b.y)
+            return;
+        double dir = a.y < b.y ? 1 : -1;
+        if (a.y > b.y)
+            swap(a, b);
+
+        double dxdy = (b.x - a.x) / (b.y - a.y);
+        int j_from = max(int(floor(a.y)), y_begin), j_to = min(int(ceil(b.y)), y_end);
+        for (int j = j_from; j < j_to; j++) {
+            double ya = max(a.y, double(j)), yb = min(b.y, double(j + 1));
+            if (yb <= ya)
+                continue;
+            add_row_segment(j, a.x + (ya - a.y) * dxdy, ya, a.x + (yb - a.y) * dxdy, yb, dir);
+        }
+    }
+
+    // Проход по строкам с префиксной суммой. Для каждого отрезка одинакового ненулевого покрытия
+    // вызывается f(y, x_begin, x_end, coverage), coverage из [1, 255]
+    template<typename F>
+    void resolve(bool even_odd, F &&f) {
+        auto to_byte = [&](double winding) { return uint8_t(lround(resolve_coverage(winding, even_odd) * 255)); };
+
+        for (int j = y_begin; j < y_end; j++) {
+            auto &cells = rows[j - y_begin];
+            sort(cells.begin(), cells.end(), [](const Cell &a, const Cell &b) { return a.x < b.x; });
+
+            double winding = 0;
+            size_t i = 0;
+            while (i < cells.size()) {
+                int x = cells[i].x;
+                double area = 0, cover = 0;
+                for (; i < cells.size() && cells[i].x == x; i++) {
+                    area += cells[i].area;
+                    cover += cells[i].cover;
+                }
+
+                uint8_t coverage = to_byte(winding + area);
+                if (x >= x_begin && coverage != 0)
+                    f(j, x, x + 1, coverage);
+
+                winding += cover;
+                int next_x = i < cells.size() ? cells[i].x : x_end;
+                coverage = to_byte(winding);
+                if (coverage != 0 && x + 1 < next_x)
+                    f(j, max(x + 1, x_begin), next_x, coverage);
+            }
+        }
+    }
+};
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "polygon.h"
+#include "point_batch.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <thread>
+#include <tuple>
 
 struct Face {
     array<Point<int>, 4> points;
@@ -13,11 +18,11 @@ struct Face {
          const Point<int> &center,
          const Point<int> &n) : points(points), center(center), n(n) {}
 
-    void draw_bounds(Magick::Image &img, const Magick::Color &color) const {
-        draw_line(points[0], points[1], img, color);
-        draw_line(points[1], points[2], img, color);
-        draw_line(points[2], points[3], img, color);
-        draw_line(points[3], points[0], img, color);
+    void draw_bounds(Magick::Image &img, const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) const {
+        draw_line(points[0], points[1], img, color, mode);
+        draw_line(points[1], points[2], img, color, mode);
+        draw_line(points[2], points[3], img, color, mode);
+        draw_line(points[3], points[0], img, color, mode);
     }
 };
 
@@ -65,13 +70,25 @@ public:
     }
 
     void rotate(double alpha, double betta, double gamma, const Point<int> &r_center = {0, 0, 0}) {
+        // вершины, центры граней и центр поворачиваются одним проходом по общей матрице
+        PointBatch<int32_t> batch(faces.size() * 5 + 1);
+        size_t k = 0;
         for (auto &face: faces) {
-            for (auto &v: face.points) {
-                v.rotate(alpha, betta, gamma, r_center);
-            }
-            face.center.rotate(alpha, betta, gamma, r_center);
+            for (auto &v: face.points)
+                batch.set(k++, v);
+            batch.set(k++, face.center);
+        }
+        batch.set(k, center);
+
+        batch.rotate(RotationMatrix(alpha, betta, gamma), r_center);
+
+        k = 0;
+        for (auto &face: faces) {
+            for (auto &v: face.points)
+                v = batch[k++];
+            face.center = batch[k++];
         }
-        center.rotate(alpha, betta, gamma, r_center);
+        center = batch[k];
 
         fix_normals();
     }
@@ -83,70 +100,235 @@ public:
     }
 
     // Удаления невидимых ребер "проволочной" модели параллелепипеда.
-    void draw(Magick::Image &img, const Magick::Color &color) const {
+    void draw(Magick::Image &img, const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) const {
         for (auto &face: faces) {
             if (face.n.z < 0)
-                face.draw_bounds(img, color);
+                face.draw_bounds(img, color, mode);
         }
     }
 
     // Построение параллельной проекции повернутого параллелепипеда на плоскость Z = n.
-    void draw_bounds(Magick::Image &img, const Magick::Color &color) const {
+    void draw_bounds(Magick::Image &img, const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) const {
         for (auto &face: faces)
-            face.draw_bounds(img, color);
+            face.draw_bounds(img, color, mode);
     }
 
     // Построение одноточечной перспективной проекции повернутого параллелепипеда. Центр проекции находится в точке [0, 0, 1/r].
-    void draw_one_point_projection(double r, Magick::Image &img, const Magick::Color &color) const {
-        Point<int> center_projection = one_point_transform(center, r);
-        for (auto &face: faces) {
-            Point<int> face_center = one_point_transform(face.center, r);
-            array<Point<int>, 4> points;
-            for (size_t i = 0; i < face.points.size(); i++)
-                points[i] = one_point_transform(face.points[i], r);
-
-            Point<int> n = cross(points[1] - points[0], points[2] - points[1]);
-            if (n * (center_projection - face_center) < 0)
-                n = -n;
-            if (n.z < 0)
-                continue;
+    void draw_one_point_projection(double r, Magick::Image &img, const Magick::Color &color,
+                                   BlendMode mode = BlendMode::SourceOver) const {
+        draw_perspective([r](const Point<int> &point) {
+            return HomogeneousPoint{double(point.x), double(point.y), double(point.z), 1 + r * point.z};
+        }, img, color, mode);
+    }
+
+    // Построение одноточечной перспективной проекции повернутого параллелепипеда. Центр проекции находится в точке [1/p, 1/q, 0].
+    void draw_two_point_projection(double p, double q, Magick::Image &img, const Magick::Color &color,
+                                   BlendMode mode = BlendMode::SourceOver) const {
+        draw_perspective([p, q](const Point<int> &point) {
+            return HomogeneousPoint{double(point.x), double(point.y), double(point.z), 1 + p * point.x + q * point.y};
+        }, img, color, mode);
+    }
 
-            draw_line(points[0], points[1], img, color);
-            draw_line(points[1], points[2], img, color);
-            draw_line(points[2], points[3], img, color);
-            draw_line(points[3], points[0], img, color);
+    // Точка после перспективного преобразования до деления на w
+    struct HomogeneousPoint {
+        double x, y, z, w;
+
+        HomogeneousPoint lerp(const HomogeneousPoint &to, double t) const {
+            return {x + t * (to.x - x), y + t * (to.y - y), z + t * (to.z - z), w + t * (to.w - w)};
+        }
+
+        Point<int> project() const {
+            double c = 1.0 / w;
+            return {int(round(c * x)), int(round(c * y)), int(round(c * z))};
         }
+    };
+
+    // Точки ближе к центру проекции (и за ним) отсекаются плоскостью w = NEAR_W
+    static constexpr double NEAR_W = 1e-6;
+
+    // Отсечение отрезка до деления на w (Лианг-Барски) ближней плоскостью и пирамидой видимости,
+    // которая после деления становится прямоугольником изображения. false, если от отрезка ничего не осталось
+    static bool clip_homogeneous(HomogeneousPoint &a, HomogeneousPoint &b, double width, double height) {
+        double t_from = 0, t_to = 1;
+        // f(a), f(b) — значения линейной функции, которая должна быть неотрицательной
+        auto clip = [&](double fa, double fb) {
+            if (fa < 0 && fb < 0)
+                return false;
+            if (fa < 0)
+                t_from = max(t_from, fa / (fa - fb));
+            else if (fb < 0)
+                t_to = min(t_to, fa / (fa - fb));
+            return true;
+        };
+
+        if (!clip(a.w - NEAR_W, b.w - NEAR_W) ||
+            !clip(a.x, b.x) || !clip(width * a.w - a.x, width * b.w - b.x) ||
+            !clip(a.y, b.y) || !clip(height * a.w - a.y, height * b.w - b.y) ||
+            t_from > t_to)
+            return false;
+
+        HomogeneousPoint from = a;
+        if (t_from > 0)
+            a = from.lerp(b, t_from);
+        if (t_to < 1)
+            b = from.lerp(b, t_to);
+        return true;
     }
 
-    // Построение одноточечной перспективной проекции повернутого параллелепипеда. Центр проекции находится в точке [1/p, 1/q, 0].
-    void draw_two_point_projection(double p, double q, Magick::Image &img, const Magick::Color &color) const {
-        Point<int> center_projection = two_point_transform(center, p, q);
+private:
+
+    // Видимость грани по ориентации ее части перед ближней плоскостью. Перспективное преобразование
+    // с w > 0 сохраняет ориентацию, поэтому внутренняя нормаль после проекции смотрит туда же, куда и до нее
+    template<typename Transform>
+    bool is_face_visible(const Face &face, Transform &&transform) const {
+        Point<int> n = cross(face.points[1] - face.points[0], face.points[2] - face.points[1]);
+        int orientation = sgn(n * face.n);
+
+        array<HomogeneousPoint, 8> clipped;
+        size_t count = 0;
+        bool whole = true;
+        for (size_t i = 0; i < face.points.size(); i++) {
+            HomogeneousPoint a = transform(face.points[i]);
+            HomogeneousPoint b = transform(face.points[(i + 1) % face.points.size()]);
+            whole = whole && a.w >= NEAR_W;
+            if (a.w >= NEAR_W)
+                clipped[count++] = a;
+            if ((a.w >= NEAR_W) != (b.w >= NEAR_W))
+                clipped[count++] = a.lerp(b, (a.w - NEAR_W) / (a.w - b.w));
+        }
+        if (count < 3)
+            return false;
+
+        // если грань целиком перед плоскостью, берем тот же треугольник, что и для нормали, иначе всю отсеченную часть
+        size_t k = whole ? 3 : count;
+        double area = 0;
+        for (size_t i = 0; i < k; i++) {
+            const HomogeneousPoint &a = clipped[i], &b = clipped[(i + 1) % k];
+            area += a.x / a.w * (b.y / b.w) - a.y / a.w * (b.x / b.w);
+        }
+        return orientation * area >= 0;
+    }
+
+    template<typename Transform>
+    void draw_perspective(Transform &&transform, Magick::Image &img, const Magick::Color &color, BlendMode mode) const {
+        double width = double(img.columns()) - 1, height = double(img.rows()) - 1;
         for (auto &face: faces) {
-            Point<int> face_center = two_point_transform(face.center, p, q);
-            array<Point<int>, 4> points;
-            for (size_t i = 0; i < face.points.size(); i++)
-                points[i] = two_point_transform(face.points[i], p, q);
-
-            Point<int> n = cross(points[1] - points[0], points[2] - points[1]);
-            if (n * (center_projection - face_center) < 0)
-                n = -n;
-            if (n.z < 0)
+            if (!is_face_visible(face, transform))
                 continue;
 
-            draw_line(points[0], points[1], img, color);
-            draw_line(points[1], points[2], img, color);
-            draw_line(points[2], points[3], img, color);
-            draw_line(points[3], points[0], img, color);
+            for (size_t i = 0; i < face.points.size(); i++) {
+                HomogeneousPoint a = transform(face.points[i]);
+                HomogeneousPoint b = transform(face.points[(i + 1) % face.points.size()]);
+                if (clip_homogeneous(a, b, width, height))
+                    draw_line(a.project(), b.project(), img, color, mode);
+            }
         }
     }
+};
 
+// Параметры одного экземпляра параллелепипеда: центр, углы поворота, размеры по осям и цвет
+struct BoxInstance {
+    Point<double> position;
+    Point<double> rotation;
+    Point<double> scale = {1, 1, 1};
+    Magick::Color color;
+};
+
+// Единичный куб с центром в начале координат, общий для всех экземпляров.
+// Экземпляры преобразуются и отсекаются параллельно пачками, видимые грани сортируются по глубине
+// и заполняются за один проход (параллельная проекция на плоскость Z, как в Cube::draw)
+class BoxMesh {
 private:
+    array<Point<double>, 8> vertices;
+    array<array<int, 4>, 6> faces = {{{0, 3, 2, 1}, {4, 5, 6, 7}, {0, 1, 5, 4}, {1, 2, 6, 5}, {2, 3, 7, 6}, {3, 0, 4, 7}}};
+    array<Point<double>, 6> normals = {{{0, 0, -1}, {0, 0, 1}, {0, -1, 0}, {1, 0, 0}, {0, 1, 0}, {-1, 0, 0}}};
+
+    struct ScreenFace {
+        array<Point<int>, 4> points;
+        double depth;
+        size_t instance;
+        size_t face;
+    };
+
+    static constexpr size_t BATCH_SIZE = 1024;
+
+    void transform_batch(span<const BoxInstance> instances, size_t from, size_t to, int width, int height,
+                         vector<ScreenFace> &out) const {
+        for (size_t id = from; id < to; id++) {
+            const BoxInstance &instance = instances[id];
+            RotationMatrix r(instance.rotation.x, instance.rotation.y, instance.rotation.z);
+            auto apply = [&](const Point<double> &p) {
+                return Point<double>(r.m[0][0] * p.x + r.m[0][1] * p.y + r.m[0][2] * p.z,
+                                     r.m[1][0] * p.x + r.m[1][1] * p.y + r.m[1][2] * p.z,
+                                     r.m[2][0] * p.x + r.m[2][1] * p.y + r.m[2][2] * p.z);
+            };
+
+            array<Point<double>, 8> points;
+            double x_min = INFINITY, x_max = -INFINITY, y_min = INFINITY, y_max = -INFINITY;
+            for (size_t i = 0; i < vertices.size(); i++) {
+                const Point<double> &v = vertices[i];
+                points[i] = instance.position + apply({v.x * instance.scale.x, v.y * instance.scale.y, v.z * instance.scale.z});
+                x_min = min(x_min, points[i].x);
+                x_max = max(x_max, points[i].x);
+                y_min = min(y_min, points[i].y);
+                y_max = max(y_max, points[i].y);
+            }
+            // экземпляр целиком вне изображения
+            if (x_max < 0 || y_max < 0 || x_min >= width || y_min >= height)
+                continue;
+
+            for (size_t f = 0; f < faces.size(); f++) {
+                // наблюдатель со стороны +z, видны грани с внешней нормалью n.z > 0
+                if (apply(normals[f]).z <= 0)
+                    continue;
+                ScreenFace face{{}, 0, id, f};
+                for (size_t k = 0; k < 4; k++) {
+                    face.points[k] = to_int_point(points[faces[f][k]]);
+                    face.depth += points[faces[f][k]].z / 4;
+                }
+                out.push_back(face);
+            }
+        }
+    }
 
-    Point<int> one_point_transform(const Point<int> &point, double r) const {
-        return point.multiply(1.0 / (1 + r * point.z));
+public:
+    BoxMesh() {
+        for (int i = 0; i < 8; i++) {
+            // нижнее основание 0..3 и верхнее 4..7 обходятся одинаково
+            int k = i % 4;
+            vertices[i] = {k == 1 || k == 2 ? 0.5 : -0.5, k >= 2 ? 0.5 : -0.5, i < 4 ? -0.5 : 0.5};
+        }
     }
 
-    Point<int> two_point_transform(const Point<int> &point, double p, double q) const {
-        return point.multiply(1.0 / (1 + p * point.x + q * point.y));
+    // Возвращает число нарисованных граней. threads = 0 — по числу ядер
+    size_t draw_instances(span<const BoxInstance> instances, Magick::Image &img,
+                          BlendMode mode = BlendMode::SourceOver, unsigned threads = 0) const {
+        int width = int(img.columns()), height = int(img.rows());
+        size_t batches = (instances.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+        if (threads == 0)
+            threads = max(1u, thread::hardware_concurrency());
+        threads = unsigned(min<size_t>(threads, max<size_t>(batches, 1)));
+
+        vector<vector<ScreenFace>> visible(threads);
+        atomic<size_t> next_batch = 0;
+        ThreadPool::shared().run(threads, [&](unsigned t) {
+            for (size_t batch; (batch = next_batch++) < batches;) {
+                size_t from = batch * BATCH_SIZE;
+                transform_batch(instances, from, min(from + BATCH_SIZE, instances.size()), width, height, visible[t]);
+            }
+        });
+
+        vector<ScreenFace> all;
+        for (auto &part: visible)
+            all.insert(all.end(), part.begin(), part.end());
+        // дальние грани рисуются первыми; при равной глубине порядок задают номера экземпляра и грани,
+        // поэтому результат не зависит от того, какой поток обработал какую пачку
+        sort(all.begin(), all.end(), [](const ScreenFace &a, const ScreenFace &b) {
+            return tie(a.depth, a.instance, a.face) < tie(b.depth, b.instance, b.face);
+        });
+
+        for (auto &face: all)
+            fill_convex(face.points, img, instances[face.instance].color, mode);
+        return all.size();
     }
 };
\ No newline at end of file
@@ -2,70 +2,152 @@
 
 #include <iostream>
 #include <cmath>
+#include <span>
 #include <Magick++.h>
 #include "point.h"
+#include "blend.h"
 
 using namespace std;
 
-void draw_line(int x1, int y1, int x2, int y2, Magick::Image &img, const Magick::Color &color) {
+// Закрашивание горизонтального отрезка [x_begin, x_end) строки y, выходящие за изображение пиксели отбрасываются.
+// Цвет накладывается на уже нарисованное в режиме mode с покрытием coverage из [0, 255]
+void draw_span(int y, int x_begin, int x_end, Magick::Image &img, const Magick::Color &color, uint8_t coverage = 255,
+               BlendMode mode = BlendMode::SourceOver) {
+    if (y < 0 || y >= (int) img.rows() || coverage == 0)
+        return;
+    x_begin = max(x_begin, 0);
+    x_end = min(x_end, (int) img.columns());
+    if (x_begin >= x_end)
+        return;
+
+    // непрозрачный цвет поверх — просто запись
+    if (coverage == 255 && mode == BlendMode::SourceOver && color.quantumAlpha() >= QuantumRange) {
+        for (int x = x_begin; x < x_end; x++)
+            img.pixelColor(x, y, color);
+        return;
+    }
+
+    blend_span(img, y, x_begin, x_end, color, coverage, mode);
+}
+
+// Закрашивание вертикального отрезка [y_begin, y_end) столбца x, аналогично draw_span
+void draw_vertical_span(int x, int y_begin, int y_end, Magick::Image &img, const Magick::Color &color,
+                        uint8_t coverage = 255, BlendMode mode = BlendMode::SourceOver) {
+    if (x < 0 || x >= (int) img.columns() || coverage == 0)
+        return;
+    y_begin = max(y_begin, 0);
+    y_end = min(y_end, (int) img.rows());
+    if (y_begin >= y_end)
+        return;
+
+    if (coverage == 255 && mode == BlendMode::SourceOver && color.quantumAlpha() >= QuantumRange) {
+        for (int y = y_begin; y < y_end; y++)
+            img.pixelColor(x, y, color);
+        return;
+    }
+
+    blend_region(img, x, y_begin, 1, y_end - y_begin, color, coverage, mode);
+}
+
+// Прямая алгоритмом Брезенхема, но по отрезкам: длина каждого горизонтального (или вертикального) отрезка
+// считается сразу делением из ошибки Брезенхема, и весь отрезок закрашивается одним вызовом.
+// Пиксели совпадают с попиксельным вариантом: ошибка error = delta_x - delta_y, шаг по главной оси делается
+// всегда, по второй — когда 2 * error < delta_x (для пологой прямой) или 2 * error > -delta_y (для крутой)
+void draw_line(int x1, int y1, int x2, int y2, Magick::Image &img, const Magick::Color &color,
+               BlendMode mode = BlendMode::SourceOver) {
     if (x1 > x2) {
         swap(x1, x2);
         swap(y1, y2);
     }
-    const int delta_x = abs(x2 - x1), delta_y = abs(y2 - y1);
-    const int step_x = x1 < x2 ? 1 : -1, step_y = y1 < y2 ? 1 : -1;
-    int error = delta_x - delta_y;
-    img.pixelColor(x2, y2, color);
-    while (x1 != x2 || y1 != y2) {
-        img.pixelColor(x1, y1, color);
-        int error2 = error * 2;
-        if (error2 > -delta_y) {
-            error -= delta_y;
-            x1 += step_x;
-        }
-        if (error2 < delta_x) {
-            error += delta_x;
+    const long long delta_x = x2 - x1, delta_y = abs(y2 - y1);
+    const int step_y = y1 < y2 ? 1 : -1;
+    long long error = delta_x - delta_y;
+
+    if (delta_x >= delta_y) {
+        // в строке k шагов только по x, пока 2 * error >= delta_x, затем диагональный шаг
+        while (y1 != y2) {
+            long long k = 2 * error >= delta_x ? (2 * error - delta_x) / (2 * delta_y) + 1 : 0;
+            draw_span(y1, x1, int(x1 + k + 1), img, color, 255, mode);
+            error += delta_x - (k + 1) * delta_y;
+            x1 += int(k + 1);
             y1 += step_y;
         }
+        draw_span(y1, x1, x2 + 1, img, color, 255, mode);
+        return;
+    }
+
+    // в столбце k шагов только по y, пока 2 * error <= -delta_y, затем диагональный шаг
+    while (x1 != x2) {
+        long long k = 2 * error <= -delta_y ? (-delta_y - 2 * error) / (2 * delta_x) + 1 : 0;
+        int y_end = int(y1 + step_y * k);
+        draw_vertical_span(x1, min(y1, y_end), max(y1, y_end) + 1, img, color, 255, mode);
+        error += delta_x * (k + 1) - delta_y;
+        x1++;
+        y1 = y_end + step_y;
     }
+    draw_vertical_span(x1, min(y1, y2), max(y1, y2) + 1, img, color, 255, mode);
 }
 
-void draw_line(const Point<int> &from, const Point<int> &to, Magick::Image &img, const Magick::Color &color) {
-    draw_line(from.x, from.y, to.x, to.y, img, color);
+void draw_line(const Point<int> &from, const Point<int> &to, Magick::Image &img, const Magick::Color &color,
+               BlendMode mode = BlendMode::SourceOver) {
+    draw_line(from.x, from.y, to.x, to.y, img, color, mode);
 }
 
-void draw_bezier_curve_3(const vector<Point<int>> &init_points, Magick::Image &img, const Magick::Color &color) {
+// Точка кубической кривой Безье с опорными точками curve_points при параметре t
+Point<double> bezier_point_3(span<const Point<double>> curve_points, double t) {
+    static const int coeffs[] = {1, 3, 3, 1};
+    size_t n = curve_points.size();
+    Point<double> p = {0.0, 0.0};
+    for (size_t i = 0; i < n; i++) {
+        p += curve_points[i] * (coeffs[i] * pow((1 - t), n - i - 1) * pow(t, i));
+    }
+    return p;
+}
+
+// Ломаная, которой рисуется кубическая кривая Безье
+vector<Point<int>> flatten_bezier_curve_3(const vector<Point<int>> &init_points) {
     if (init_points.size() != 4)
         throw runtime_error("Expected 4 points");
 
     size_t n = init_points.size();
-    vector<int> coeffs = {1, 3, 3, 1};
     vector<Point<double>> curve_points(n);
     for (size_t i = 0; i < n; ++i) {
         curve_points[i] = to_double_point(init_points[i]);
     }
-    Point<int> last = init_points[0];
+    vector<Point<int>> polyline = {init_points[0]};
     for (double t = 0.0; t <= 1.0; t += 0.01) {
-        Point<double> p = {0.0, 0.0};
-        for (size_t i = 0; i < n; i++) {
-            p += curve_points[i] * (coeffs[i] * pow((1 - t), n - i - 1) * pow(t, i));
-        }
-
-
-        Point<int> cur = to_int_point(p);
-        if ((cur - last).mod2() > 3) {
-            draw_line(last.x, last.y, cur.x, cur.y, img, color);
-            last = cur;
-        }
+        Point<int> cur = to_int_point(bezier_point_3(curve_points, t));
+        if ((cur - polyline.back()).mod2() > 3)
+            polyline.push_back(cur);
     }
-    draw_line(last, init_points.back(), img, color);
+    polyline.push_back(init_points.back());
+    return polyline;
 }
 
-void draw_composite_bezier_curve_3(const vector<Point<int>> &init_points, Magick::Image &img, const Magick::Color &color) {
-    for (int i = 0; i < init_points.size() - 1; i += 3) {
+vector<Point<int>> flatten_composite_bezier_curve_3(const vector<Point<int>> &init_points) {
+    vector<Point<int>> polyline;
+    for (size_t i = 0; i + 1 < init_points.size(); i += 3) {
         if (init_points.size() <= i + 3)
             throw runtime_error("Wrong number of init_points");
 
-        draw_bezier_curve_3({init_points[i], init_points[i + 1], init_points[i + 2], init_points[i + 3]}, img, color);
+        auto part = flatten_bezier_curve_3({init_points[i], init_points[i + 1], init_points[i + 2], init_points[i + 3]});
+        polyline.insert(polyline.end(), part.begin() + (polyline.empty() ? 0 : 1), part.end());
     }
+    return polyline;
+}
+
+void draw_polyline(span<const Point<int>> polyline, Magick::Image &img, const Magick::Color &color,
+                   BlendMode mode = BlendMode::SourceOver) {
+    for (size_t i = 1; i < polyline.size(); i++)
+        draw_line(polyline[i - 1], polyline[i], img, color, mode);
+}
+
+void draw_bezier_curve_3(const vector<Point<int>> &init_points, Magick::Image &img, const Magick::Color &color,
+                         BlendMode mode = BlendMode::SourceOver) {
+    draw_polyline(flatten_bezier_curve_3(init_points), img, color, mode);
+}
+
+void draw_composite_bezier_curve_3(const vector<Point<int>> &init_points, Magick::Image &img, const Magick::Color &color,
+                                   BlendMode mode = BlendMode::SourceOver) {
+    draw_polyline(flatten_composite_bezier_curve_3(init_points), img, color, mode);
 }
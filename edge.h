@@ -16,8 +16,8 @@ public:
 
     Edge(const Point<int> &a, const Point<int> &b, const Point<int> &n) : a(a), b(b), n(n) {}
 
-    void draw(Magick::Image &img, const Magick::Color &color) const {
-        draw_line(a.x, a.y, b.x, b.y, img, color);
+    void draw(Magick::Image &img, const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) const {
+        draw_line(a.x, a.y, b.x, b.y, img, color, mode);
     }
 
     Point<int> get_center() const {
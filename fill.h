@@ -0,0 +1,97 @@
+#pragma once
+
+#include "draw.h"
+#include <vector>
+#include <Magick++.h>
+
+using namespace std;
+
+enum class Connectivity {
+    Four,
+    Eight,
+};
+
+// Заполнение с затравкой области, ограниченной пикселями цвета boundary (каждая компонента отличается
+// не больше чем на tolerance), начиная с пикселя seed. Вместо рекурсии используется стек отрезков строк:
+// отрезок закрашивается целиком, а соседние строки под ним просматриваются позже. Строка изображения
+// читается один раз при первом обращении, поэтому каждый пиксель закрашивается ровно один раз и
+// полупрозрачный цвет не накладывается сам на себя. Возвращает число закрашенных пикселей.
+size_t seed_fill(const Point<int> &seed, const Magick::Color &boundary, Magick::Image &img,
+                 const Magick::Color &color, Connectivity connectivity = Connectivity::Four, double tolerance = 0,
+                 BlendMode mode = BlendMode::SourceOver) {
+    enum State : uint8_t {
+        Unknown,
+        Free,
+        Boundary,
+        Filled,
+    };
+    struct ScanSpan {
+        int y, x_begin, x_end;
+    };
+
+    int width = (int) img.columns(), height = (int) img.rows();
+    if (seed.x < 0 || seed.y < 0 || seed.x >= width || seed.y >= height)
+        return 0;
+
+    static thread_local vector<uint8_t> state;
+    static thread_local vector<ScanSpan> stack;
+    state.assign((size_t) width * height, Unknown);
+    stack.clear();
+
+    size_t channels = img.channels();
+    double bounds[3] = {boundary.quantumRed(), boundary.quantumGreen(), boundary.quantumBlue()};
+    auto is_boundary = [&](double r, double g, double b) {
+        return abs(r - bounds[0]) <= tolerance && abs(g - bounds[1]) <= tolerance && abs(b - bounds[2]) <= tolerance;
+    };
+    // строка классифицируется целиком до первой записи в нее
+    auto load_row = [&](int y) -> uint8_t * {
+        uint8_t *row = state.data() + (size_t) y * width;
+        if (row[0] != Unknown)
+            return row;
+        if (channels < 3) {
+            for (int x = 0; x < width; x++) {
+                Magick::Color c = img.pixelColor(x, y);
+                row[x] = is_boundary(c.quantumRed(), c.quantumGreen(), c.quantumBlue()) ? Boundary : Free;
+            }
+            return row;
+        }
+        const Magick::Quantum *p = img.getConstPixels(0, y, width, 1);
+        for (int x = 0; x < width; x++, p += channels)
+            row[x] = is_boundary(p[0], p[1], p[2]) ? Boundary : Free;
+        return row;
+    };
+
+    // у 8-связной области соседи по диагонали тоже считаются, поэтому просматриваемый отрезок шире на пиксель
+    int extend = connectivity == Connectivity::Eight ? 1 : 0;
+    size_t filled = 0;
+    stack.push_back({seed.y, seed.x, seed.x + 1});
+    while (!stack.empty()) {
+        ScanSpan cur = stack.back();
+        stack.pop_back();
+        if (cur.y < 0 || cur.y >= height)
+            continue;
+
+        uint8_t *row = load_row(cur.y);
+        int x = max(cur.x_begin, 0), x_end = min(cur.x_end, width);
+        while (x < x_end) {
+            if (row[x] != Free) {
+                x++;
+                continue;
+            }
+            int left = x, right = x + 1;
+            while (left > 0 && row[left - 1] == Free)
+                left--;
+            while (right < width && row[right] == Free)
+                right++;
+
+            fill(row + left, row + right, Filled);
+            draw_span(cur.y, left, right, img, color, 255, mode);
+            filled += right - left;
+
+            stack.push_back({cur.y - 1, left - extend, right + extend});
+            stack.push_back({cur.y + 1, left - extend, right + extend});
+            x = right;
+        }
+    }
+    return filled;
+}
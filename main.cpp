@@ -6,6 +6,11 @@
 #include <vector>
 #include "polygon.h"
 #include "cube.h"
+#include "scene.h"
+#include "point_batch.h"
+#include "stroke.h"
+#include "fill.h"
+#include "arc_length.h"
 #include <Magick++.h>
 
 using namespace std;
@@ -17,6 +22,12 @@ const Magick::Color Blue(0, 0, DEPTH);
 const Magick::Color Black(0, 0, 0);
 const Magick::Color Orange(DEPTH, 0.3 * DEPTH, 0);
 
+// Цвета совпадают с точностью до округления при смешивании
+bool near(const Magick::Color &a, const Magick::Color &b) {
+    return abs(a.quantumRed() - b.quantumRed()) < 300 && abs(a.quantumGreen() - b.quantumGreen()) < 300 &&
+           abs(a.quantumBlue() - b.quantumBlue()) < 300;
+}
+
 void save_img(Magick::Image &img, const string &filename) {
     img.flip();
     img.magick("png");
@@ -98,6 +109,156 @@ void test_stars() {
     save_img(img, "stars.png");
 }
 
+// Проверка принадлежности точки выпуклому полигону бинарным поиском и заполнение по двум цепочкам ребер
+void test_convex() {
+    vector<Point<int>> points = {Point{100, 100}, Point{250, 350}, Point{400, 400}, Point{380, 320}, Point{250, 150}};
+    for (int k = 0; k < 2; k++) {
+        Polygon pol(points);
+        assert(pol.is_convex());
+
+        // точка внутри, если она по внутреннюю сторону от всех сторон
+        auto edges = pol.get_edges();
+        for (int i = 50; i < 450; i += 7) {
+            for (int j = 50; j < 450; j += 7) {
+                bool inside = true;
+                for (auto &edge: edges)
+                    inside = inside && edge.n * (Point{i, j} - edge.a) >= 0;
+                assert(pol.is_inside_convex({i, j}) == inside);
+            }
+        }
+
+        Magick::Image img("500x500", "white");
+        pol.fill_polygon(Polygon::FillingMethod::EvenOddRule, img, Orange);
+        assert(img.pixelColor(300, 300) == Orange);
+        assert(img.pixelColor(120, 300) != Orange);
+        std::reverse(points.begin(), points.end());
+    }
+
+    // коллинеарные вершины не должны делать принадлежащей всю прямую стороны
+    Polygon square({{0, 5}, {0, 0}, {10, 0}, {10, 10}, {0, 10}});
+    assert(square.is_convex());
+    assert(!square.is_inside_convex({0, -50}) && !square.is_inside_convex({0, 50}));
+    assert(square.is_inside_convex({0, 5}) && square.is_inside_convex({5, 5}));
+    Polygon triangle({{35, 34}, {3, 45}, {35, 54}, {35, 44}});
+    assert(!triangle.is_inside_convex({35, 55}) && !triangle.is_inside_convex({35, 100}));
+    assert(triangle.is_inside_convex({35, 44}) && triangle.is_inside_convex({20, 45}));
+    assert(!triangle.is_inside_even_odd_rule({35, 100}));
+}
+
+// Триангуляция простого полигона: n - 2 треугольника, суммарная площадь равна площади полигона
+void test_triangulation() {
+    for (int k = 5; k < 60; k += 3) {
+        // звездчатый полигон с чередующимися радиусами простой, но невыпуклый
+        vector<Point<int>> points;
+        for (int i = 0; i < k; i++) {
+            double angle = 2 * M_PI * i / k, r = i % 2 ? 100 : 200 + (i * 17) % 60;
+            points.emplace_back(250 + int(r * cos(angle)), 250 + int(r * sin(angle)));
+        }
+        Polygon pol(points);
+        assert(pol.is_simple());
+
+        auto edges = pol.get_edges();
+        long long area = 0;
+        for (auto &edge: edges)
+            area += vec_area(edge.a, edge.b);
+
+        long long triangles_area = 0;
+        for (auto &t: pol.get_triangles())
+            triangles_area += abs(vec_area(edges[t[1]].a - edges[t[0]].a, edges[t[2]].a - edges[t[0]].a));
+        assert(pol.get_triangles().size() == points.size() - 2);
+        assert(triangles_area == abs(area));
+    }
+
+    vector<Point<int>> points = {{50, 50}, {250, 100}, {450, 50}, {300, 250}, {450, 450}, {250, 300}, {50, 450}, {200, 250}};
+    Polygon pol(points);
+    Magick::Image img("500x500", "white");
+    pol.fill_polygon(Polygon::FillingMethod::Triangulation, img, Orange);
+    pol.move({0, 10});
+    pol.fill_polygon(Polygon::FillingMethod::Triangulation, img, Green);
+    pol.draw_bounds(img, Black);
+    assert(img.pixelColor(250, 105) == Orange);
+    assert(img.pixelColor(250, 305) == Green);
+    assert(img.pixelColor(250, 400) != Green);
+    save_img(img, "triangulation.png");
+}
+
+// Сглаженное заполнение: суммарное покрытие равно площади, внутри звезды правила дают разный результат
+void test_antialiased_fill() {
+    vector<Point<int>> square = {{10, 10}, {30, 15}, {25, 35}, {5, 30}};
+    CoverageAccumulator accumulator;
+    accumulator.reset(0, 50, 0, 50);
+    for (size_t i = 0; i < square.size(); i++)
+        accumulator.add_line(to_double_point(square[i]), to_double_point(square[(i + 1) % square.size()]));
+    double area = 0;
+    accumulator.resolve(false, [&](int, int x_begin, int x_end, uint8_t coverage) {
+        area += (x_end - x_begin) * coverage / 255.0;
+    });
+    assert(abs(area - 425) < 1);
+
+    // вершины далеко левее изображения: часть ребер вне области сворачивается в одну ячейку на строку
+    vector<Point<double>> far = {{-1e9, 10}, {20, 10}, {20, 30}, {-1e9, 50}};
+    accumulator.reset(0, 50, 0, 50);
+    for (size_t i = 0; i < far.size(); i++)
+        accumulator.add_line(far[i], far[(i + 1) % far.size()]);
+    area = 0;
+    accumulator.resolve(true, [&](int, int x_begin, int x_end, uint8_t coverage) {
+        area += (x_end - x_begin) * coverage / 255.0;
+    });
+    assert(abs(area - 400) < 1);
+
+    vector<Point<int>> points = {{150, 200},
+                                 {460, 350},
+                                 {90,  350},
+                                 {400, 200},
+                                 {250, 460}};
+    Magick::Image img("1000x800", "white");
+    Polygon star1(points);
+    star1.move({60, -150});
+    star1.fill_polygon_antialiased(Polygon::FillingMethod::NonZeroWinding, img, Orange);
+
+    Polygon star2(points);
+    star2.move({500, 300});
+    star2.fill_polygon_antialiased(Polygon::FillingMethod::EvenOddRule, img, Orange);
+    save_img(img, "stars_antialiased.png");
+
+    assert(img.pixelColor(335, 150) == Orange);
+    assert(img.pixelColor(775, 600) == Magick::Color("white"));
+    assert(img.pixelColor(750, 740) == Orange);
+}
+
+// Полупрозрачные заливки и режимы наложения поверх уже нарисованного
+void test_blending() {
+    Rgba8 pixels[3] = {{255, 255, 255, 255}, {0, 0, 0, 255}, {0, 0, 0, 0}};
+    blend_span(pixels, 3, Rgba8{128, 0, 0, 128}, 255, BlendMode::SourceOver);
+    assert(pixels[0].r == 255 && pixels[0].g == 127 && pixels[0].a == 255);
+    assert(pixels[1].r == 128 && pixels[1].g == 0 && pixels[1].a == 255);
+    assert(pixels[2].r == 128 && pixels[2].a == 128);
+
+    vector<Point<int>> points = {{150, 200},
+                                 {460, 350},
+                                 {90,  350},
+                                 {400, 200},
+                                 {250, 460}};
+    Magick::Image img("1000x800", "white");
+    Polygon star(points);
+    star.fill_polygon(Polygon::FillingMethod::NonZeroWinding, img, Red);
+
+    Polygon box({{50, 150}, {50, 450}, {500, 450}, {500, 150}});
+    Magick::Color translucent_blue(0, 0, DEPTH, DEPTH / 2);
+    box.fill_polygon(Polygon::FillingMethod::EvenOddRule, img, translucent_blue, BlendMode::SourceOver);
+    assert(near(img.pixelColor(275, 300), Magick::Color(DEPTH / 2, 0, DEPTH / 2)));
+    assert(near(img.pixelColor(60, 160), Magick::Color(DEPTH / 2, DEPTH / 2, DEPTH)));
+
+    box.move({450, 0});
+    box.fill_polygon(Polygon::FillingMethod::EvenOddRule, img, Orange, BlendMode::Multiply);
+    assert(near(img.pixelColor(700, 300), Orange));
+
+    draw_line(0, 500, 999, 500, img, Blue, BlendMode::Additive);
+    draw_line(0, 500, 999, 500, img, Red, BlendMode::Additive);
+    assert(near(img.pixelColor(10, 500), Magick::Color("white")));
+    save_img(img, "blending.png");
+}
+
 // Построения кривых Безье третьего порядка
 void test_bezier() {
     Magick::Image img("300x300", "white");
@@ -121,6 +282,234 @@ void test_composite_bezier() {
     save_img(img, "bezier_composite_line.png");
 }
 
+// Прямые по отрезкам: max(|dx|, |dy|) + 1 пикселей, каждый закрашивается один раз, по одному пикселю на шаг главной оси
+void test_line_runs() {
+    vector<array<int, 4>> lines = {{10,  20,  290, 20},
+                                   {20,  290, 20,  10},
+                                   {0,   0,   299, 299},
+                                   {10,  250, 290, 170},
+                                   {280, 15,  230, 285},
+                                   {150, 150, 150, 150},
+                                   {-50, 100, 350, 130}};
+    for (auto [x1, y1, x2, y2]: lines) {
+        Magick::Image img("300x300", Black);
+        Magick::Color dim(DEPTH / 16, DEPTH / 16, DEPTH / 16);
+        draw_line(x1, y1, x2, y2, img, dim, BlendMode::Additive);
+
+        bool x_major = abs(x2 - x1) >= abs(y2 - y1);
+        map<int, int> per_step;
+        int count = 0;
+        for (int y = 0; y < 300; y++) {
+            for (int x = 0; x < 300; x++) {
+                double v = img.pixelColor(x, y).quantumRed();
+                assert(v < DEPTH / 16 + 300);
+                if (v > DEPTH / 32) {
+                    count++;
+                    per_step[x_major ? x : y]++;
+                }
+            }
+        }
+        int x_from = max(min(x1, x2), 0), x_to = min(max(x1, x2), 299);
+        assert(count == (x_major ? x_to - x_from : abs(y2 - y1)) + 1);
+        for (auto [step, pixels]: per_step)
+            assert(pixels == 1);
+        if (x1 >= 0 && x1 < 300)
+            assert(img.pixelColor(x1, y1).quantumRed() > DEPTH / 32);
+        if (x2 >= 0 && x2 < 300)
+            assert(img.pixelColor(x2, y2).quantumRed() > DEPTH / 32);
+    }
+}
+
+// Таблица длины дуги: равномерное движение вдоль составной кривой Безье
+void test_arc_length() {
+    ArcLengthTable line({{0, 0}, {100, 0}, {200, 0}, {300, 0}});
+    assert(abs(line.length() - 300) < 1e-6);
+    assert(abs(line.t_at(150) - 0.5) < 1e-3);
+    assert(abs(line.distance_at(0.25) - 75) < 1e-3);
+
+    vector<Point<int>> points = {{100, 200},
+                                 {150, 250},
+                                 {200, 300},
+                                 {250, 250},
+                                 {300, 200},
+                                 {350, 300},
+                                 {400, 200}};
+    ArcLengthTable composite(points);
+    ArcLengthTable first({points.begin(), points.begin() + 4}), second({points.begin() + 3, points.end()});
+    assert(composite.segments() == 2);
+    assert(abs(composite.length() - first.length() - second.length()) < 1e-6);
+    assert(abs(composite.distance_at(1) - first.length()) < 1e-6);
+    for (double t = 0; t <= 2; t += 0.125)
+        assert(abs(composite.t_at(composite.distance_at(t)) - t) < 1e-9);
+
+    Magick::Image img("500x400", "white");
+    draw_composite_bezier_curve_3(points, img, Black);
+    double step = composite.length() / 20;
+    for (int i = 0; i <= 20; i++) {
+        Point<int> marker = to_int_point(composite.point_at_distance(i * step));
+        fill_convex(array<Point<int>, 4>{marker + Point<int>(-2, -2), marker + Point<int>(-2, 3),
+                                         marker + Point<int>(3, 3), marker + Point<int>(3, -2)}, img, Red);
+        if (i > 0) {
+            double chord = sqrt((composite.point_at_distance(i * step) -
+                                 composite.point_at_distance((i - 1) * step)).mod2());
+            assert(abs(chord - step) < 0.01 * step);
+        }
+    }
+    save_img(img, "arc_length.png");
+}
+
+// Толстые ломаные: каждый пиксель обводки закрашивается один раз, поэтому полупрозрачный цвет в соединениях не темнеет
+void test_stroke() {
+    Magick::Color white("white"), half_blue(DEPTH / 2, DEPTH / 2, DEPTH);
+    Magick::Color translucent_blue(0, 0, DEPTH, DEPTH / 2);
+
+    vector<Point<int>> polyline = {{100, 100},
+                                   {400, 100},
+                                   {400, 300},
+                                   {150, 350}};
+    Magick::Image img("1000x800", "white");
+    StrokeStyle miter{20, LineJoin::Miter, LineCap::Butt};
+    draw_stroke(polyline, miter, img, translucent_blue);
+    assert(near(img.pixelColor(250, 100), half_blue));
+    assert(near(img.pixelColor(400, 100), half_blue));
+    assert(near(img.pixelColor(409, 91), half_blue));
+    assert(near(img.pixelColor(400, 300), half_blue));
+    assert(near(img.pixelColor(250, 115), white));
+    assert(near(img.pixelColor(95, 100), white));
+
+    for (auto &point: polyline)
+        point += Point<int>(0, 400);
+    StrokeStyle round{20, LineJoin::Round, LineCap::Round};
+    draw_stroke(polyline, round, img, translucent_blue);
+    assert(near(img.pixelColor(95, 500), half_blue));
+    assert(near(img.pixelColor(409, 491), white));
+
+    for (auto &point: polyline)
+        point += Point<int>(450, 0);
+    StrokeStyle bevel{20, LineJoin::Bevel, LineCap::Square};
+    draw_stroke(polyline, bevel, img, translucent_blue);
+    assert(near(img.pixelColor(545, 491), half_blue));
+    assert(near(img.pixelColor(859, 491), white));
+
+    draw_composite_bezier_stroke_3({{500, 200},
+                                    {550, 50},
+                                    {650, 50},
+                                    {700, 200},
+                                    {750, 350},
+                                    {850, 350},
+                                    {900, 200}}, {6, LineJoin::Round, LineCap::Round}, img, Red);
+    save_img(img, "stroke.png");
+}
+
+// Кэш покрытия: после сдвига и смены цвета звезда закрашивается сохраненными отрезками так же, как без кэша
+void test_coverage_cache() {
+    vector<Point<int>> points = {{150, 200},
+                                 {460, 350},
+                                 {90,  350},
+                                 {400, 200},
+                                 {250, 460}};
+    Magick::Image cached("1000x800", "white"), direct("1000x800", "white");
+    Polygon star(points), reference(points);
+    star.set_coverage_cache(true);
+    assert(star.has_coverage_cache() && !reference.has_coverage_cache());
+
+    vector<pair<Point<int>, Magick::Color>> draws = {{{0,    0},    Orange},
+                                                     {{500,  300},  Green},
+                                                     {{-450, 50},   Blue},
+                                                     {{600,  -450}, Red}};
+    // правила чередуются, у каждого своя маска
+    for (size_t i = 0; i < draws.size(); i++) {
+        auto &[shift, color] = draws[i];
+        auto method = i % 2 ? Polygon::FillingMethod::NonZeroWinding : Polygon::FillingMethod::EvenOddRule;
+        star.move(shift);
+        reference.move(shift);
+        star.fill_polygon(method, cached, color);
+        reference.fill_polygon(method, direct, color);
+    }
+    star.fill_polygon(Polygon::FillingMethod::NonZeroWinding, cached, Black);
+    reference.fill_polygon(Polygon::FillingMethod::NonZeroWinding, direct, Black);
+
+    for (int y = 0; y < 800; y++) {
+        for (int x = 0; x < 1000; x++)
+            assert(cached.pixelColor(x, y) == direct.pixelColor(x, y));
+    }
+    save_img(cached, "coverage_cache.png");
+}
+
+// Выпуклая оболочка и быстрая проверка пересечения выпуклых полигонов перед отсечением
+void test_convex_hull_overlap() {
+    vector<Point<int>> points = {{150, 200},
+                                 {460, 350},
+                                 {90,  350},
+                                 {400, 200},
+                                 {250, 460},
+                                 {250, 300},
+                                 {300, 250},
+                                 {275, 200},
+                                 {150, 200}};
+    Polygon star(vector<Point<int>>(points.begin(), points.begin() + 5));
+    Polygon hull = convex_hull(points);
+    assert(hull.is_convex());
+    assert(hull.size() == 5);
+    for (auto &point: points)
+        assert(hull.is_inside_convex(point));
+    assert(convex_hull(star).size() == 5);
+    assert(convex_hull(vector<Point<int>>{{0, 0}, {5, 5}, {10, 10}}).size() == 2);
+
+    Polygon square({{500, 100}, {500, 300}, {700, 300}, {700, 100}});
+    Polygon triangle({{600, 50}, {800, 250}, {800, 50}});
+    Polygon far_triangle({{690, 340}, {760, 270}, {760, 340}});
+    Polygon touching({{700, 300}, {700, 400}, {800, 300}});
+    assert(convex_polygons_intersect(square, triangle));
+    assert(!convex_polygons_intersect(square, far_triangle));
+    assert(convex_polygons_intersect(square, touching));
+    assert(!convex_polygons_intersect(hull, square));
+
+    // пересекаются ограничивающие прямоугольники, но не сами полигоны
+    assert(square.get_bbox().intersects(far_triangle.get_bbox()));
+    assert(weiler_atherton(square, far_triangle).size() == 0);
+    assert(weiler_atherton(square, triangle).size() > 0);
+
+    Magick::Image img("1000x800", "white");
+    hull.fill_polygon(Polygon::FillingMethod::EvenOddRule, img, Green);
+    star.draw_bounds(img, Black);
+    square.draw_bounds(img, Black);
+    triangle.draw_bounds(img, Red);
+    far_triangle.draw_bounds(img, Blue);
+    save_img(img, "convex_hull.png");
+}
+
+// Заполнение с затравкой областей, ограниченных уже нарисованными контурами
+void test_seed_fill() {
+    Magick::Color white("white");
+    Magick::Image img("1000x800", "white");
+
+    Polygon box({{50, 50}, {50, 350}, {450, 350}, {450, 50}});
+    box.draw_bounds(img, Black);
+    size_t filled = seed_fill({200, 200}, Black, img, Green);
+    assert(filled == 399 * 299);
+    assert(img.pixelColor(51, 51) == Green && img.pixelColor(449, 349) == Green);
+    assert(img.pixelColor(50, 50) == Black && img.pixelColor(40, 40) == white);
+
+    // диагональная граница пропускает 8-связную заливку
+    draw_line(500, 350, 800, 50, img, Black);
+    draw_line(500, 50, 800, 50, img, Black);
+    draw_line(500, 50, 500, 350, img, Black);
+    seed_fill({550, 100}, Black, img, Blue, Connectivity::Four);
+    assert(img.pixelColor(550, 100) == Blue && img.pixelColor(850, 300) == white);
+    seed_fill({850, 300}, Black, img, Red, Connectivity::Eight);
+    assert(img.pixelColor(850, 300) == Red && img.pixelColor(550, 100) == Red);
+
+    // граница, близкая к черному, учитывается только с допуском
+    Magick::Color dark(1000, 1000, 1000);
+    draw_bezier_curve_3({{100, 500}, {100, 800}, {400, 800}, {400, 500}}, img, dark);
+    draw_line(100, 500, 400, 500, img, dark);
+    size_t inside = seed_fill({250, 600}, Black, img, Orange, Connectivity::Four, 1500);
+    assert(inside > 0 && inside < 300 * 300);
+    assert(img.pixelColor(250, 450) != Orange);
+    save_img(img, "seed_fill.png");
+}
+
 // Отсечения отрезков прямых выпуклым полигоном
 void test_draw_clip() {
     auto clipping = [](Magick::Image &img, const vector<Point<int>> &points) {
@@ -155,6 +544,38 @@ void test_draw_clip() {
     save_img(img2, "clip_line_reverse.png");
 }
 
+// Пакетные операции над точками совпадают с поточечными
+void test_point_batch() {
+    vector<Point<int>> a, b;
+    for (int i = 0; i < 100; i++) {
+        a.emplace_back(i * 7 % 201 - 100, i * 13 % 157 - 70, i * 29 % 91 - 45);
+        b.emplace_back(i * 11 % 83 - 40, i * 3 % 67 - 30, i * 17 % 59 - 25);
+    }
+    PointBatch<int32_t> batch_a(a), batch_b(b);
+
+    auto sum = batch_a + batch_b;
+    auto dot = batch_a.dot(batch_b);
+    auto crs = batch_a.cross(batch_b);
+    auto scaled = batch_a.multiply(0.37);
+    RotationMatrix rotation(M_PI / 5, M_PI / 7, -M_PI / 3);
+    PointBatch<int32_t> rotated = batch_a;
+    rotated.rotate(rotation, {5, -3, 8});
+    for (size_t i = 0; i < a.size(); i++) {
+        assert(sum[i] == a[i] + b[i]);
+        assert(dot[i] == a[i] * b[i]);
+        assert(crs[i] == cross(a[i], b[i]));
+        assert(scaled[i] == a[i].multiply(0.37));
+        Point<int> p = a[i];
+        p.rotate(M_PI / 5, M_PI / 7, -M_PI / 3, {5, -3, 8});
+        assert(rotated[i] == p);
+    }
+    assert(batch_a.to_points() == a);
+
+    PointBatch<float> floats(vector<Point<float>>{{1, 0, 0}, {0, 2, 0}});
+    floats.rotate(RotationMatrix(0, 0, M_PI / 2));
+    assert(abs(floats[0].y - 1) < 1e-6 && abs(floats[1].x + 2) < 1e-6);
+}
+
 void test_projection() {
     Magick::Image img("500x500", "white");
 
@@ -175,6 +596,117 @@ void test_two_point_projection() {
     save_img(img, "two_point_projection.png");
 }
 
+// Куб, пересекающий плоскость центра проекции: вершины за центром отсекаются до деления на w
+// Смешивание для проволочной модели: рисуются те же пиксели, что и непрозрачным цветом
+void test_blended_cube() {
+    Cube cube({150, 150, 100}, 200, 200, 200);
+    cube.rotate(M_PI / 6, M_PI / 5, 0, cube.get_center());
+
+    Magick::Image opaque("500x500", Black), blended("500x500", Black);
+    cube.draw_one_point_projection(1e-3, opaque, Magick::Color("white"));
+    Magick::Color dim(DEPTH / 4, 0, 0);
+    cube.draw_one_point_projection(1e-3, blended, dim, BlendMode::Additive);
+    for (int y = 0; y < 500; y++) {
+        for (int x = 0; x < 500; x++) {
+            bool drawn = opaque.pixelColor(x, y) != Black;
+            double red = blended.pixelColor(x, y).quantumRed();
+            assert(drawn == (red > 0));
+            assert(blended.pixelColor(x, y).quantumGreen() == 0);
+        }
+    }
+
+    Magick::Image img("500x500", "white");
+    cube.draw(img, Orange);
+    cube.draw_bounds(img, Magick::Color(0, 0, DEPTH, DEPTH / 2), BlendMode::SourceOver);
+    cube.draw_two_point_projection(0.001, 0.001, img, Blue, BlendMode::Multiply);
+    save_img(img, "blended_cube.png");
+}
+
+void test_projection_clipping() {
+    Magick::Color white("white");
+    auto drawn_pixels = [&](const Magick::Image &img) {
+        size_t count = 0;
+        for (size_t y = 0; y < img.rows(); y++) {
+            for (size_t x = 0; x < img.columns(); x++)
+                count += img.pixelColor(x, y) != white;
+        }
+        return count;
+    };
+
+    // параллелепипед целиком за центром проекции не рисуется
+    Magick::Image behind("500x500", "white");
+    Cube hidden({150, 150, -600}, 200, 200, 200);
+    hidden.rotate(M_PI / 6, M_PI / 5, 0, hidden.get_center());
+    hidden.draw_one_point_projection(1e-2, behind, Black);
+    hidden.draw_two_point_projection(-0.01, -0.01, behind, Black);
+    assert(drawn_pixels(behind) == 0);
+
+    // отрезок через центр проекции обрезается ближней плоскостью, а видимая часть — прямоугольником изображения
+    Cube::HomogeneousPoint a{100, 100, 0, 1}, b{100, 100, -200, -1};
+    assert(Cube::clip_homogeneous(a, b, 499, 499));
+    assert(a.w >= Cube::NEAR_W && b.w >= Cube::NEAR_W * (1 - 1e-9));
+    for (auto &point: {a.project(), b.project()})
+        assert(0 <= point.x && point.x <= 499 && 0 <= point.y && point.y <= 499);
+
+    Cube::HomogeneousPoint left{-1e6, 250, 0, 1}, right{1e6, 250, 0, 1};
+    assert(Cube::clip_homogeneous(left, right, 499, 499));
+    assert(left.project().x == 0 && right.project().x == 499);
+
+    Cube::HomogeneousPoint outside1{600, 100, 0, 1}, outside2{700, 400, 0, 1};
+    assert(!Cube::clip_homogeneous(outside1, outside2, 499, 499));
+
+    // параллелепипед, пересекающий плоскость центра проекции, рисуется своей видимой частью
+    Magick::Image img("500x500", "white");
+    Cube cube({150, 150, -300}, 200, 200, 400);
+    cube.rotate(M_PI / 6, M_PI / 5, 0, cube.get_center());
+    cube.draw_one_point_projection(1e-2, img, Black);
+    assert(drawn_pixels(img) > 0);
+    cube.draw_two_point_projection(0.004, -0.003, img, Blue);
+    save_img(img, "projection_clipping.png");
+}
+
+// Много параллелепипедов за один вызов: невидимые грани и экземпляры вне изображения не рисуются
+void test_instances() {
+    Magick::Image img("1000x800", "white");
+    BoxMesh mesh;
+
+    vector<BoxInstance> boxes = {
+            {{500, 400, 0}, {0, 0, 0}, {100, 100, 100}, Orange},
+            {{-500, 400, 0}, {0, 0, 0}, {100, 100, 100}, Green},
+            {{200, 200, 0}, {M_PI / 6, M_PI / 5, 0}, {120, 60, 80}, Blue},
+    };
+    assert(mesh.draw_instances(boxes, img) == 4);
+    assert(img.pixelColor(500, 400) == Orange);
+
+    vector<BoxInstance> grid;
+    for (int i = 0; i < 100; i++) {
+        for (int j = 0; j < 80; j++) {
+            Magick::Color color(DEPTH * (i % 5) / 4, DEPTH * (j % 3) / 2, DEPTH / 2);
+            grid.push_back({{i * 10.0 + 5, j * 10.0 + 5, double(i + j)}, {i * 0.1, j * 0.1, 0}, {8, 8, 8}, color});
+        }
+    }
+    Magick::Image single = img;
+    size_t faces = mesh.draw_instances(grid, img, BlendMode::SourceOver, 4);
+    assert(mesh.draw_instances(grid, single, BlendMode::SourceOver, 1) == faces);
+    // у многих граней сетки одинаковая глубина, порядок их отрисовки не должен зависеть от числа потоков
+    for (int y = 0; y < 800; y++) {
+        for (int x = 0; x < 1000; x++)
+            assert(img.pixelColor(x, y) == single.pixelColor(x, y));
+    }
+
+    // потоки пула переиспользуются между вызовами
+    Magick::Image again("1000x800", "white"), again_single("1000x800", "white");
+    for (int k = 0; k < 3; k++) {
+        mesh.draw_instances(grid, again, BlendMode::SourceOver, 3);
+        mesh.draw_instances(grid, again_single, BlendMode::SourceOver, 1);
+    }
+    for (int y = 0; y < 800; y++) {
+        for (int x = 0; x < 1000; x++)
+            assert(again.pixelColor(x, y) == again_single.pixelColor(x, y));
+    }
+    save_img(img, "instances.png");
+}
+
 void draw_animation() {
     int a = 200, b = 200, h = 300;
     Cube cube({200, 200, 0}, a, b, h);
@@ -280,8 +812,108 @@ void test_weiler_atherton3() {
     save_img(img, "weiler_atherton3.png");
 }
 
+// Пространственный индекс сцены должен давать те же ответы, что и полный перебор
+void test_scene() {
+    vector<Polygon> polygons;
+    for (int i = 0; i < 300; i++) {
+        int x = (i * 37) % 1000, y = (i * 91) % 800, r = 5 + (i * 13) % 40;
+        polygons.emplace_back(vector<Point<int>>{{x, y}, {x + r, y + r / 2}, {x + r / 3, y + r}});
+    }
+    polygons.emplace_back(vector<Point<int>>{{0, 0}, {900, 50}, {500, 700}});
+    Scene scene(polygons);
+
+    auto check = [&]() {
+        for (int x = -10; x < 1100; x += 23) {
+            for (int y = -10; y < 900; y += 19) {
+                vector<size_t> expected;
+                for (size_t id = 0; id < polygons.size(); id++) {
+                    if (polygons[id].is_inside_even_odd_rule({x, y}))
+                        expected.push_back(id);
+                }
+                assert(scene.hit_test({x, y}) == expected);
+            }
+        }
+
+        BBox rect(200, 450, 100, 300);
+        vector<size_t> expected;
+        for (size_t id = 0; id < polygons.size(); id++) {
+            if (polygons[id].get_bbox().intersects(rect))
+                expected.push_back(id);
+        }
+        assert(scene.query(rect) == expected);
+
+        vector<pair<size_t, size_t>> pairs;
+        for (size_t i = 0; i < polygons.size(); i++) {
+            for (size_t j = i + 1; j < polygons.size(); j++) {
+                if (polygons[i].get_bbox().intersects(polygons[j].get_bbox()))
+                    pairs.emplace_back(i, j);
+            }
+        }
+        assert(scene.candidate_pairs() == pairs);
+    };
+
+    check();
+    for (size_t id = 0; id < polygons.size(); id += 7) {
+        Point<int> shift((int) id % 50 - 25, 1200 - (int) id * 3);
+        polygons[id].move(shift);
+        scene.move(id, shift);
+    }
+    check();
+
+    // кэши полигонов заполняются лениво, одновременные запросы к новой сцене должны давать те же ответы
+    Scene shared(polygons);
+    vector<size_t> hits(4);
+    vector<thread> workers;
+    for (size_t t = 0; t < hits.size(); t++) {
+        workers.emplace_back([&, t] {
+            for (int x = -10; x < 1100; x += 23) {
+                for (int y = -10; y < 900; y += 19)
+                    hits[t] += shared.hit_test({x, y}).size();
+            }
+        });
+    }
+    for (auto &worker: workers)
+        worker.join();
+    for (size_t t = 1; t < hits.size(); t++)
+        assert(hits[t] == hits[0]);
+}
+
+// Отсечение в цикле с переиспользуемой ареной: после первой итерации новых блоков памяти не берется
+void test_arena_clipping() {
+    Polygon pol1(vector<Point<int>>{{100, 200}, {100, 450}, {300, 450}, {300, 200}});
+    Polygon pol2(vector<Point<int>>{{150, 150}, {150, 400}, {400, 400}, {250, 300}, {400, 150}});
+    Polygon expected = weiler_atherton(pol1, pol2);
+
+    Arena arena(1024);
+    size_t allocations = 0, scratch_allocations = 0;
+    for (int i = 0; i < 1000; i++) {
+        arena.reset();
+        Polygon res = weiler_atherton(pol1, pol2, &arena);
+        assert(res.size() == expected.size());
+        if (i == 0) {
+            allocations = arena.allocation_count();
+            scratch_allocations = scratch_arena().allocation_count();
+        }
+    }
+    assert(arena.allocation_count() == allocations);
+    assert(scratch_arena().allocation_count() == scratch_allocations);
+}
+
 int main() {
 //    test_polygon_type();
+    test_convex();
+    test_scene();
+    test_triangulation();
+    test_antialiased_fill();
+    test_blending();
+    test_line_runs();
+    test_arc_length();
+    test_stroke();
+    test_seed_fill();
+    test_coverage_cache();
+    test_convex_hull_overlap();
+    test_arena_clipping();
+    test_point_batch();
 //    test_draw_line();
 //    test_stars();
 //    test_bezier();
@@ -289,6 +921,9 @@ int main() {
 //    test_draw_clip();
     test_projection();
     test_two_point_projection();
+    test_projection_clipping();
+    test_blended_cube();
+    test_instances();
 //    draw_animation();
     test_weiler_atherton1();
     test_weiler_atherton2();
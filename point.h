@@ -5,6 +5,26 @@
 
 using namespace std;
 
+// Матрица поворота на углы alpha, betta, gamma вокруг осей x, y, z, тригонометрия считается один раз
+struct RotationMatrix {
+    double m[3][3];
+
+    RotationMatrix(double alpha, double betta, double gamma) {
+        double cos_a = cos(alpha), sin_a = sin(alpha);
+        double cos_b = cos(betta), sin_b = sin(betta);
+        double cos_g = cos(gamma), sin_g = sin(gamma);
+        m[0][0] = cos_b * cos_g;
+        m[0][1] = -(sin_g * cos_b);
+        m[0][2] = sin_b;
+        m[1][0] = sin_a * sin_b * cos_g + sin_g * cos_a;
+        m[1][1] = -sin_a * sin_b * sin_g + cos_a * cos_g;
+        m[1][2] = -(sin_a * cos_b);
+        m[2][0] = sin_a * sin_g - sin_b * cos_a * cos_g;
+        m[2][1] = sin_a * cos_g + sin_b * sin_g * cos_a;
+        m[2][2] = cos_a * cos_b;
+    }
+};
+
 template<typename T>
 class Point {
 public:
@@ -34,19 +54,14 @@ public:
     }
 
     void rotate(double alpha, double betta, double gamma, const Point<int> &center = {0, 0, 0}) {
-        double cos_a = cos(alpha), sin_a = sin(alpha);
-        double cos_b = cos(betta), sin_b = sin(betta);
-        double cos_g = cos(gamma), sin_g = sin(gamma);
+        rotate(RotationMatrix(alpha, betta, gamma), center);
+    }
+
+    void rotate(const RotationMatrix &r, const Point<int> &center = {0, 0, 0}) {
         Point<int> p = *this - center;
-        x = center.x + cos_b * cos_g * p.x - sin_g * cos_b * p.y + sin_b * p.z;
-        y = center.y +
-            (sin_a * sin_b * cos_g + sin_g * cos_a) * p.x +
-            (-sin_a * sin_b * sin_g + cos_a * cos_g) * p.y -
-            sin_a * cos_b * p.z;
-        z = center.z +
-            (sin_a * sin_g - sin_b * cos_a * cos_g) * p.x +
-            (sin_a * cos_g + sin_b * sin_g * cos_a) * p.y +
-            cos_a * cos_b * p.z;
+        x = center.x + r.m[0][0] * p.x + r.m[0][1] * p.y + r.m[0][2] * p.z;
+        y = center.y + r.m[1][0] * p.x + r.m[1][1] * p.y + r.m[1][2] * p.z;
+        z = center.z + r.m[2][0] * p.x + r.m[2][1] * p.y + r.m[2][2] * p.z;
     }
 
     template<typename C>
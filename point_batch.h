@@ -0,0 +1,124 @@
+#pragma once
+
+#include "point.h"
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Набор точек в виде структуры массивов: координаты лежат в отдельных непрерывных массивах,
+// поэтому операции над всеми точками — простые циклы, которые компилятор векторизует.
+// Результаты совпадают с поточечными операциями Point<T>
+template<typename T>
+class PointBatch {
+    static_assert(is_same_v<T, float> || is_same_v<T, int32_t>, "PointBatch supports float and int32_t");
+
+public:
+    vector<T> x, y, z;
+
+    PointBatch() = default;
+
+    explicit PointBatch(size_t n) : x(n), y(n), z(n) {}
+
+    explicit PointBatch(const vector<Point<T>> &points) : PointBatch(points.size()) {
+        for (size_t i = 0; i < points.size(); i++)
+            set(i, points[i]);
+    }
+
+    vector<Point<T>> to_points() const {
+        vector<Point<T>> points(size());
+        for (size_t i = 0; i < size(); i++)
+            points[i] = (*this)[i];
+        return points;
+    }
+
+    size_t size() const {
+        return x.size();
+    }
+
+    Point<T> operator[](size_t i) const {
+        return Point<T>(x[i], y[i], z[i]);
+    }
+
+    void set(size_t i, const Point<T> &p) {
+        x[i] = p.x;
+        y[i] = p.y;
+        z[i] = p.z;
+    }
+
+    void push_back(const Point<T> &p) {
+        x.push_back(p.x);
+        y.push_back(p.y);
+        z.push_back(p.z);
+    }
+
+    PointBatch &operator+=(const Point<T> &shift) {
+        for (size_t i = 0; i < size(); i++) {
+            x[i] += shift.x;
+            y[i] += shift.y;
+            z[i] += shift.z;
+        }
+        return *this;
+    }
+
+    PointBatch &operator+=(const PointBatch &other) {
+        for (size_t i = 0; i < size(); i++) {
+            x[i] += other.x[i];
+            y[i] += other.y[i];
+            z[i] += other.z[i];
+        }
+        return *this;
+    }
+
+    PointBatch operator+(const PointBatch &other) const {
+        PointBatch result = *this;
+        result += other;
+        return result;
+    }
+
+    // Скалярные произведения соответствующих точек
+    vector<T> dot(const PointBatch &other) const {
+        vector<T> result(size());
+        for (size_t i = 0; i < size(); i++)
+            result[i] = x[i] * other.x[i] + y[i] * other.y[i] + z[i] * other.z[i];
+        return result;
+    }
+
+    PointBatch cross(const PointBatch &other) const {
+        PointBatch result(size());
+        for (size_t i = 0; i < size(); i++) {
+            result.x[i] = y[i] * other.z[i] - z[i] * other.y[i];
+            result.y[i] = -x[i] * other.z[i] + z[i] * other.x[i];
+            result.z[i] = x[i] * other.y[i] - y[i] * other.x[i];
+        }
+        return result;
+    }
+
+    // Умножение на число с округлением, как Point::multiply
+    PointBatch<int32_t> multiply(double c) const {
+        PointBatch<int32_t> result(size());
+        for (size_t i = 0; i < size(); i++) {
+            result.x[i] = int32_t(round(c * x[i]));
+            result.y[i] = int32_t(round(c * y[i]));
+            result.z[i] = int32_t(round(c * z[i]));
+        }
+        return result;
+    }
+
+    // Поворот всех точек вокруг center, как Point::rotate. Для int32_t считается в double с отбрасыванием
+    // дробной части, для float — в float
+    void rotate(const RotationMatrix &r, const Point<T> &center = {0, 0, 0}) {
+        using F = conditional_t<is_same_v<T, float>, float, double>;
+        F m[3][3];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++)
+                m[i][j] = F(r.m[i][j]);
+        }
+
+        for (size_t i = 0; i < size(); i++) {
+            T px = x[i] - center.x, py = y[i] - center.y, pz = z[i] - center.z;
+            x[i] = T(center.x + m[0][0] * px + m[0][1] * py + m[0][2] * pz);
+            y[i] = T(center.y + m[1][0] * px + m[1][1] * py + m[1][2] * pz);
+            z[i] = T(center.z + m[2][0] * px + m[2][1] * py + m[2][2] * pz);
+        }
+    }
+};
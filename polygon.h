@@ -1,9 +1,18 @@
 #pragma once
 
 #include "draw.h"
+#include "coverage.h"
 #include "edge.h"
+#include "arena.h"
 #include <cmath>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <climits>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <span>
 
 class BBox {
 public:
@@ -12,7 +21,9 @@ public:
 
     BBox() : x_min(0), x_max(0), y_min(0), y_max(0) {}
 
-    explicit BBox(const vector<Edge> &edges) {
+    BBox(int x_min, int x_max, int y_min, int y_max) : x_min(x_min), x_max(x_max), y_min(y_min), y_max(y_max) {}
+
+    explicit BBox(span<const Edge> edges) {
         x_min = x_max = edges[0].a.x;
         y_min = y_max = edges[0].a.y;
         for (auto &edge: edges) {
@@ -24,6 +35,14 @@ public:
         }
     }
 
+    bool contains(const Point<int> &point) const {
+        return x_min <= point.x && point.x <= x_max && y_min <= point.y && point.y <= y_max;
+    }
+
+    bool intersects(const BBox &other) const {
+        return max(x_min, other.x_min) <= min(x_max, other.x_max) && max(y_min, other.y_min) <= min(y_max, other.y_max);
+    }
+
     ~BBox() = default;
 };
 
@@ -32,42 +51,184 @@ int sgn(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
-class Polygon {
-private:
-    vector<Edge> edges;
-    BBox bbox;
+inline long long floor_div(long long a, long long b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+// Проход по цепочке вершин выпуклого полигона от верхней вершины к нижней.
+// Для каждой строки y хранит ceil(x) точки пересечения с цепочкой, x считается в целых числах инкрементально
+class EdgeWalker {
+    span<const Point<int>> points;
+    size_t cur;
+    int step;
+    long long q = 0, r = 0;        // x = a.x + q + r / den
+    long long den = 1, step_q = 0, step_r = 0;
+
+    size_t next_index(size_t i) const {
+        return (i + points.size() + step) % points.size();
+    }
+
+    void start_edge(int y) {
+        // пропускаем ребра, закончившиеся не ниже строки y (в том числе горизонтальные)
+        while (points[next_index(cur)].y <= y)
+            cur = next_index(cur);
+        const Point<int> &a = points[cur], &b = points[next_index(cur)];
+        den = b.y - a.y;
+        long long num = b.x - a.x;
+        step_q = floor_div(num, den);
+        step_r = num - step_q * den;
+        q = floor_div((y - a.y) * num, den);
+        r = (y - a.y) * num - q * den;
+    }
+
 public:
-    Polygon() = default;
+    // step = 1 или -1 задает направление обхода, строка y должна быть выше нижней вершины
+    EdgeWalker(span<const Point<int>> points, size_t top, int step, int y) : points(points), cur(top), step(step) {
+        start_edge(y);
+    }
 
-    explicit Polygon(vector<Point<int>> points) {
-        // проверяем, что полигон ориентирован по часовой стрелке
-        int area = 0;
-        for (int i = 1; i < points.size(); i++) {
-            area += vec_area(points[i] - points[i - 1], points[(i + 1) % points.size()] - points[i - 1]);
+    int ceil_x() const {
+        return points[cur].x + int(q) + (r > 0);
+    }
+
+    void next_line(int y) {
+        if (points[next_index(cur)].y <= y) {
+            start_edge(y);
+            return;
+        }
+        q += step_q;
+        r += step_r;
+        if (r >= den) {
+            r -= den;
+            q++;
         }
-        if (area > 0)
-            std::reverse(points.begin(), points.end());
+    }
+};
 
-        edges = vector<Edge>(points.size());
-        for (size_t i = 0; i < points.size(); i++) {
-            edges[i] = {points[i], points[(i + 1) % points.size()]};
+// Заполнение выпуклого полигона по строкам: границы каждой строки дают две цепочки ребер слева и справа.
+// Для пикселей с y из [y_min, y_max) и x из [x_left, x_right) вызывается emit(y, x_left, x_right),
+// поэтому соседние полигоны не перекрываются
+template<typename F>
+void rasterize_convex(span<const Point<int>> points, F emit) {
+    if (points.size() <= 2)
+        return;
+
+    size_t top = 0, bottom = 0;
+    for (size_t i = 1; i < points.size(); i++) {
+        if (points[i].y < points[top].y)
+            top = i;
+        if (points[i].y > points[bottom].y)
+            bottom = i;
+    }
+    int y_from = points[top].y, y_to = points[bottom].y;
+    if (y_from == y_to)
+        return;
+
+    EdgeWalker left(points, top, 1, y_from), right(points, top, -1, y_from);
+    for (int y = y_from; y < y_to; y++) {
+        if (y != y_from) {
+            left.next_line(y);
+            right.next_line(y);
         }
+        int x1 = left.ceil_x(), x2 = right.ceil_x();
+        if (x1 > x2)
+            swap(x1, x2);
+        emit(y, x1, x2);
+    }
+}
 
-        bbox = BBox(edges);
+void fill_convex(span<const Point<int>> points, Magick::Image &img, const Magick::Color &color,
+                 BlendMode mode = BlendMode::SourceOver) {
+    rasterize_convex(points, [&](int y, int x_begin, int x_end) {
+        draw_span(y, x_begin, x_end, img, color, 255, mode);
+    });
+}
 
-        auto center = get_center();
-        for (auto &edge: edges) {
-            if (edge.n * (center - edge.get_center()) < 0)
-                edge.n = -edge.n;
+// Значение, вычисляемое при первом обращении из константных методов. Вычисление идет под мьютексом,
+// а готовое значение читается без блокировки, поэтому константные методы можно вызывать из нескольких потоков
+template<typename T>
+class Lazy {
+private:
+    mutable mutex m;
+    mutable atomic<bool> ready = false;
+    mutable optional<T> value;
+
+public:
+    Lazy() = default;
+
+    Lazy(const Lazy &other) {
+        lock_guard lock(other.m);
+        value = other.value;
+        ready = value.has_value();
+    }
+
+    Lazy(Lazy &&other) noexcept : value(std::move(other.value)) {
+        ready = value.has_value();
+    }
+
+    Lazy &operator=(const Lazy &other) {
+        if (this != &other) {
+            scoped_lock lock(m, other.m);
+            value = other.value;
+            ready = value.has_value();
         }
-    };
+        return *this;
+    }
 
-    void draw_bounds(Magick::Image &img, const Magick::Color &color) {
-        for (auto &edge: edges)
-            edge.draw(img, color);
+    Lazy &operator=(Lazy &&other) noexcept {
+        value = std::move(other.value);
+        ready = value.has_value();
+        return *this;
     }
 
-    bool is_simple() const {
+    template<typename F>
+    const T &get(F &&compute) const {
+        if (!ready.load(memory_order_acquire)) {
+            lock_guard lock(m);
+            if (!value.has_value()) {
+                value.emplace(compute());
+                ready.store(true, memory_order_release);
+            }
+        }
+        return *value;
+    }
+
+    void reset() {
+        lock_guard lock(m);
+        value.reset();
+        ready = false;
+    }
+};
+
+// Растеризованное покрытие полигона: отрезки строк [x_begin, x_end) относительно первой вершины
+struct SpanMask {
+    struct Run {
+        int y, x_begin, x_end;
+    };
+
+    vector<Run> runs;
+};
+
+class Polygon {
+private:
+    pmr::vector<Edge> edges;
+    BBox bbox;
+    struct Convexity {
+        bool convex = false;
+        int turn_sign = 0;
+        vector<size_t> corners; // вершины выпуклого полигона без коллинеарных
+    };
+
+    // простота, выпуклость и триангуляция не меняются при сдвиге, поэтому вычисляются один раз
+    Lazy<bool> simple;
+    Lazy<Convexity> convexity;
+    Lazy<vector<array<size_t, 3>>> triangles;
+    // маска покрытия хранится относительно первой вершины и переживает сдвиги и смену цвета
+    bool coverage_cache = false;
+    // маски по индексу FillingMethod
+    array<Lazy<SpanMask>, 3> masks;
+
+    bool check_simple() const {
         int n = edges.size();
         if (n <= 2)
             return false;
@@ -89,22 +250,199 @@ public:
         return true;
     }
 
-    bool is_convex() const {
+    Convexity check_convex() const {
+        Convexity result;
         if (edges.size() <= 2 || !is_simple())
-            return false;
+            return result;
+
+        // знак берем по первому ненулевому повороту, чтобы коллинеарные вершины в начале не делали любой полигон выпуклым
+        int sign = 0;
+        vector<size_t> turns;
+        for (size_t i = 0; i < edges.size(); i++) {
+            int cur = sgn(vec_area(edges[i].dir(), edges[(i + 1) % edges.size()].dir()));
+            if (cur == 0)
+                continue;
+            if (sign == 0)
+                sign = cur;
+            else if (cur != sign)
+                return result;
+            // поворот между ребрами i и i + 1 происходит в вершине i + 1
+            turns.push_back((i + 1) % edges.size());
+        }
+
+        if (sign == 0)
+            return result;
+
+        result = {true, sign, std::move(turns)};
+        return result;
+    }
 
-        int sign = sgn(vec_area(edges[0].dir(), edges[1].dir()));
-        for (size_t i = 1; i < edges.size(); i++) {
-            if (sign * vec_area(edges[i].dir(), edges[(i + 1) % edges.size()].dir()) < 0)
+    // Триангуляция отсечением ушей. Ухо не может содержать вершин, кроме вогнутых,
+    // поэтому проверяются только они: O(n * r), где r — число вогнутых вершин, для выпуклого полигона O(n)
+    vector<array<size_t, 3>> ear_clipping() const {
+        size_t n = edges.size();
+        vector<array<size_t, 3>> result;
+        if (n <= 2)
+            return result;
+        result.reserve(n - 2);
+
+        auto v = [&](size_t i) -> const Point<int> & { return edges[i].a; };
+        long long area = 0;
+        for (size_t i = 0; i < n; i++)
+            area += vec_area(v(i), v((i + 1) % n));
+        int orientation = sgn(area);
+        if (orientation == 0)
+            return result;
+
+        vector<size_t> prev(n), next(n);
+        for (size_t i = 0; i < n; i++) {
+            prev[i] = (i + n - 1) % n;
+            next[i] = (i + 1) % n;
+        }
+        auto turn = [&](size_t i) { return orientation * sgn(vec_area(v(i) - v(prev[i]), v(next[i]) - v(i))); };
+
+        vector<char> reflex(n, false);
+        vector<size_t> reflex_ids;
+        for (size_t i = 0; i < n; i++) {
+            if (turn(i) < 0) {
+                reflex[i] = true;
+                reflex_ids.push_back(i);
+            }
+        }
+
+        auto is_ear = [&](size_t i) {
+            if (turn(i) <= 0)
                 return false;
+            const Point<int> &a = v(prev[i]), &b = v(i), &c = v(next[i]);
+            for (size_t r: reflex_ids) {
+                if (!reflex[r] || r == prev[i] || r == next[i])
+                    continue;
+                const Point<int> &p = v(r);
+                if (p == a || p == c)
+                    continue;
+                if (orientation * vec_area(b - a, p - a) >= 0 &&
+                    orientation * vec_area(c - b, p - b) >= 0 &&
+                    orientation * vec_area(a - c, p - c) >= 0)
+                    return false;
+            }
+            return true;
+        };
+
+        auto remove = [&](size_t i) {
+            reflex[i] = false;
+            next[prev[i]] = next[i];
+            prev[next[i]] = prev[i];
+            for (size_t j: {prev[i], next[i]}) {
+                if (reflex[j] && turn(j) >= 0)
+                    reflex[j] = false;
+            }
+        };
+
+        size_t cur = 0, left = n, misses = 0;
+        while (left > 3 && misses < left) {
+            if (turn(cur) == 0 && !reflex[cur]) {
+                // вершина на прямой между соседями треугольника не дает
+                size_t after = next[cur];
+                remove(cur);
+                left--;
+                cur = after;
+                misses = 0;
+            } else if (is_ear(cur)) {
+                result.push_back({prev[cur], cur, next[cur]});
+                size_t after = next[cur];
+                remove(cur);
+                left--;
+                cur = after;
+                misses = 0;
+            } else {
+                cur = next[cur];
+                misses++;
+            }
         }
 
-        return true;
+        if (left == 3 && turn(cur) != 0)
+            result.push_back({prev[cur], cur, next[cur]});
+
+        return result;
+    }
+
+public:
+    Polygon() = default;
+
+    explicit Polygon(span<const Point<int>> points, pmr::memory_resource *mr = pmr::get_default_resource()) : edges(mr) {
+        size_t n = points.size();
+        if (n == 0)
+            return;
+
+        // проверяем, что полигон ориентирован по часовой стрелке, иначе обходим вершины в обратном порядке
+        int area = 0;
+        for (size_t i = 1; i < n; i++) {
+            area += vec_area(points[i] - points[i - 1], points[(i + 1) % n] - points[i - 1]);
+        }
+        auto point = [&](size_t i) -> const Point<int> & { return area > 0 ? points[n - 1 - i] : points[i]; };
+
+        edges.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            edges[i] = {point(i), point((i + 1) % n)};
+        }
+
+        bbox = BBox(edges);
+
+        auto center = get_center();
+        for (auto &edge: edges) {
+            if (edge.n * (center - edge.get_center()) < 0)
+                edge.n = -edge.n;
+        }
+    };
+
+    explicit Polygon(const vector<Point<int>> &points, pmr::memory_resource *mr = pmr::get_default_resource())
+            : Polygon(span<const Point<int>>(points), mr) {}
+
+    void draw_bounds(Magick::Image &img, const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) {
+        for (auto &edge: edges)
+            edge.draw(img, color, mode);
+    }
+
+    bool is_simple() const {
+        return simple.get([&] { return check_simple(); });
+    }
+
+    bool is_convex() const {
+        return convexity.get([&] { return check_convex(); }).convex;
+    }
+
+    // Проверка принадлежности точки выпуклому полигону (включая границу) за O(log n):
+    // бинарным поиском находим треугольник веера из первой вершины, в угол которого попадает точка.
+    // Веер строится по вершинам без коллинеарных, иначе вырожденный треугольник пропускал бы всю прямую его стороны
+    bool is_inside_convex(const Point<int> &point) const {
+        if (!is_convex())
+            return false;
+
+        const Convexity &info = convexity.get([&] { return check_convex(); });
+        size_t n = info.corners.size();
+        auto v = [&](size_t i) -> const Point<int> & { return edges[info.corners[i]].a; };
+        auto side = [&](const Point<int> &a, const Point<int> &b) { return info.turn_sign * vec_area(b - a, point - a); };
+
+        if (side(v(0), v(1)) < 0 || side(v(0), v(n - 1)) > 0)
+            return false;
+
+        size_t lo = 1, hi = n - 1; // side(v0, v[lo]) >= 0, side(v0, v[hi]) <= 0
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (side(v(0), v(mid)) >= 0)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        return side(v(lo), v(lo + 1)) >= 0;
     }
 
     bool is_inside_even_odd_rule(const Point<int> &point) const {
         if (edges.size() <= 2)
             return false;
+        if (is_convex())
+            return is_inside_convex(point);
 
         Point<int> end(0, point.y - 10);
         Edge line = {point, end};
@@ -123,6 +461,8 @@ public:
     bool is_inside_non_zero_winding(const Point<int> &point) const {
         if (edges.size() <= 2)
             return false;
+        if (is_convex())
+            return is_inside_convex(point);
 
         Point<int> end(0, point.y - 10);
         Point l = end - point;
@@ -139,35 +479,113 @@ public:
         return winding != 0;
     }
 
+    // Разбиение простого полигона на треугольники (индексы вершин), для сложного полигона пусто
+    const vector<array<size_t, 3>> &get_triangles() const {
+        return triangles.get([&] { return is_simple() ? ear_clipping() : vector<array<size_t, 3>>(); });
+    }
+
     enum FillingMethod {
         EvenOddRule,
         NonZeroWinding,
+        // заполнение закэшированными треугольниками без проверок принадлежности, только для простых полигонов,
+        // сложные полигоны заполняются по правилу even-odd
+        Triangulation,
     };
 
-    void fill_polygon(FillingMethod method, Magick::Image &img, const Magick::Color &color) const {
+    // Отрезки строк внутренних пикселей для emit(y, x_begin, x_end), без отсечения по изображению
+    template<typename F>
+    void rasterize(FillingMethod method, F emit) const {
         if (edges.size() <= 2)
             return;
 
-        switch (method) {
-            case EvenOddRule:
-                for (int i = bbox.x_min; i < bbox.x_max; i++) {
-                    for (int j = bbox.y_min; j < bbox.y_max; j++) {
-                        if (is_inside_even_odd_rule({i, j}))
-                            img.pixelColor(i, j, color);
-                    }
+        // для выпуклого полигона оба правила совпадают
+        if (is_convex()) {
+            rasterize_convex(get_vertices(), emit);
+            return;
+        }
+
+        if (method == Triangulation) {
+            if (is_simple()) {
+                for (auto &triangle: get_triangles()) {
+                    array<Point<int>, 3> points = {edges[triangle[0]].a, edges[triangle[1]].a, edges[triangle[2]].a};
+                    rasterize_convex(points, emit);
                 }
-                break;
-            case NonZeroWinding:
-                for (int i = bbox.x_min; i < bbox.x_max; i++) {
-                    for (int j = bbox.y_min; j < bbox.y_max; j++) {
-                        if (is_inside_non_zero_winding({i, j}))
-                            img.pixelColor(i, j, color);
-                    }
+                return;
+            }
+            method = EvenOddRule;
+        }
+
+        // идущие подряд внутренние пиксели строки объединяются в один отрезок
+        for (int j = bbox.y_min; j < bbox.y_max; j++) {
+            int run_begin = bbox.x_min;
+            for (int i = bbox.x_min; i <= bbox.x_max; i++) {
+                bool inside = i < bbox.x_max && (method == NonZeroWinding ? is_inside_non_zero_winding({i, j})
+                                                                          : is_inside_even_odd_rule({i, j}));
+                if (!inside) {
+                    if (run_begin < i)
+                        emit(j, run_begin, i);
+                    run_begin = i + 1;
                 }
-                break;
+            }
         }
     }
 
+    // При включенном кэше покрытие растеризуется один раз для каждого правила заполнения,
+    // а следующие заливки после move или с другим цветом только проигрывают сохраненные отрезки
+    void set_coverage_cache(bool enabled) {
+        coverage_cache = enabled;
+        if (!enabled)
+            for (auto &mask: masks)
+                mask.reset();
+    }
+
+    bool has_coverage_cache() const {
+        return coverage_cache;
+    }
+
+    void fill_polygon(FillingMethod method, Magick::Image &img, const Magick::Color &color,
+                      BlendMode mode = BlendMode::SourceOver) const {
+        if (!coverage_cache) {
+            rasterize(method, [&](int y, int x_begin, int x_end) {
+                draw_span(y, x_begin, x_end, img, color, 255, mode);
+            });
+            return;
+        }
+        if (edges.empty())
+            return;
+
+        Point<int> origin = edges[0].a;
+        const SpanMask &mask = masks[method].get([&] {
+            SpanMask result;
+            rasterize(method, [&](int y, int x_begin, int x_end) {
+                result.runs.push_back({y - origin.y, x_begin - origin.x, x_end - origin.x});
+            });
+            result.runs.shrink_to_fit();
+            return result;
+        });
+        for (auto &run: mask.runs)
+            draw_span(run.y + origin.y, run.x_begin + origin.x, run.x_end + origin.x, img, color, 255, mode);
+    }
+
+    // Сглаженное заполнение: покрытие каждого пикселя считается по площади, method задает правило заполнения
+    void fill_polygon_antialiased(FillingMethod method, Magick::Image &img, const Magick::Color &color,
+                                  BlendMode mode = BlendMode::SourceOver) const {
+        if (edges.size() <= 2)
+            return;
+
+        static thread_local CoverageAccumulator accumulator;
+        accumulator.reset(0, (int) img.columns(), max(bbox.y_min, 0), min(bbox.y_max + 1, (int) img.rows()));
+
+        // вершина с целыми координатами — центр пикселя
+        Point<double> half(0.5, 0.5);
+        for (auto &edge: edges)
+            accumulator.add_line(to_double_point(edge.a) + half, to_double_point(edge.b) + half);
+
+        accumulator.resolve(method == EvenOddRule, [&](int y, int x_begin, int x_end, uint8_t coverage) {
+            draw_span(y, x_begin, x_end, img, color, coverage, mode);
+        });
+    }
+
     Point<int> get_center() const {
         Point<int> center;
         for (auto &edge: edges) {
@@ -192,13 +610,98 @@ public:
         return edges.size();
     }
 
-    vector<Edge> get_edges() const {
+    const BBox &get_bbox() const {
+        return bbox;
+    }
+
+    const pmr::vector<Edge> &get_edges() const {
         return edges;
     }
 
+    vector<Point<int>> get_vertices() const {
+        vector<Point<int>> points(edges.size());
+        for (size_t i = 0; i < edges.size(); i++)
+            points[i] = edges[i].a;
+        return points;
+    }
+
     ~Polygon() = default;
 };
 
+// Заполнение замкнутого контура с вещественными вершинами активными ребрами строки развертки.
+// Центр пикселя (x, y) совпадает с точкой (x, y), строка пересекает ребро при a.y <= y < b.y,
+// внутренние промежутки [x_i, x_{i+1}) рисуются отрезками [ceil x_i, ceil x_{i+1}), поэтому
+// каждый пиксель закрашивается не более одного раза даже у самопересекающегося контура.
+void fill_scanline(span<const Point<double>> points, Polygon::FillingMethod method, Magick::Image &img,
+                   const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) {
+    struct ScanEdge {
+        double y_min, y_max, x, dxdy;
+        int dir;
+    };
+    struct Crossing {
+        double x;
+        int dir;
+    };
+
+    if (points.size() <= 2)
+        return;
+
+    Arena &arena = scratch_arena();
+    ArenaScope scope(arena);
+
+    pmr::vector<ScanEdge> table(&arena);
+    table.reserve(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        Point<double> a = points[i], b = points[(i + 1) % points.size()];
+        if (a.y == b.y || !isfinite(a.x + a.y + b.x + b.y))
+            continue;
+        int dir = 1;
+        if (a.y > b.y) {
+            swap(a, b);
+            dir = -1;
+        }
+        table.push_back({a.y, b.y, a.x, (b.x - a.x) / (b.y - a.y), dir});
+    }
+    if (table.empty())
+        return;
+    sort(table.begin(), table.end(), [](const ScanEdge &e1, const ScanEdge &e2) { return e1.y_min < e2.y_min; });
+
+    double y_max = table[0].y_max;
+    for (auto &edge: table)
+        y_max = max(y_max, edge.y_max);
+    int y_begin = max((int) ceil(table[0].y_min), 0);
+    int y_end = min((int) ceil(y_max), (int) img.rows());
+
+    pmr::vector<const ScanEdge *> active(&arena);
+    pmr::vector<Crossing> crossings(&arena);
+    size_t next = 0;
+    for (int y = y_begin; y < y_end; y++) {
+        while (next < table.size() && table[next].y_min <= y)
+            active.push_back(&table[next++]);
+        erase_if(active, [y](const ScanEdge *edge) { return edge->y_max <= y; });
+
+        crossings.clear();
+        for (auto edge: active)
+            crossings.push_back({edge->x + (y - edge->y_min) * edge->dxdy, edge->dir});
+        sort(crossings.begin(), crossings.end(), [](const Crossing &c1, const Crossing &c2) { return c1.x < c2.x; });
+
+        int winding = 0;
+        double span_begin = 0;
+        for (auto &crossing: crossings) {
+            bool was_inside = method == Polygon::NonZeroWinding ? winding != 0 : winding % 2 != 0;
+            winding += crossing.dir;
+            bool inside = method == Polygon::NonZeroWinding ? winding != 0 : winding % 2 != 0;
+            if (!was_inside && inside) {
+                span_begin = crossing.x;
+            } else if (was_inside && !inside) {
+                int x_begin = (int) max(ceil(span_begin), -1.0);
+                int x_end = (int) min(ceil(crossing.x), (double) img.columns());
+                draw_span(y, x_begin, x_end, img, color, 255, mode);
+            }
+        }
+    }
+}
+
 Edge cyrus_beck_clip_line(const Edge &line, const Polygon &pol) {
     Point<int> l = line.dir();
     double t1 = 0, t2 = 1;
@@ -222,25 +725,106 @@ Edge cyrus_beck_clip_line(const Edge &line, const Polygon &pol) {
     return Edge{a, b};
 }
 
+// Выпуклая оболочка множества точек монотонными цепочками за O(n log n), точки на сторонах оболочки отбрасываются
+Polygon convex_hull(span<const Point<int>> points, pmr::memory_resource *mr = pmr::get_default_resource()) {
+    vector<Point<int>> sorted(points.begin(), points.end());
+    sort(sorted.begin(), sorted.end(), [](const Point<int> &p1, const Point<int> &p2) {
+        return p1.x < p2.x || (p1.x == p2.x && p1.y < p2.y);
+    });
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+    if (sorted.size() <= 2)
+        return Polygon(sorted, mr);
+
+    auto cross = [](const Point<int> &o, const Point<int> &a, const Point<int> &b) {
+        return (long long) (a.x - o.x) * (b.y - o.y) - (long long) (a.y - o.y) * (b.x - o.x);
+    };
+    vector<Point<int>> hull(2 * sorted.size());
+    size_t k = 0;
+    // нижняя цепочка слева направо, затем верхняя справа налево
+    for (size_t i = 0; i < sorted.size(); i++) {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], sorted[i]) <= 0)
+            k--;
+        hull[k++] = sorted[i];
+    }
+    for (size_t i = sorted.size() - 1, lower = k + 1; i > 0; i--) {
+        while (k >= lower && cross(hull[k - 2], hull[k - 1], sorted[i - 1]) <= 0)
+            k--;
+        hull[k++] = sorted[i - 1];
+    }
+    hull.resize(k - 1);
+    return Polygon(hull, mr);
+}
+
+Polygon convex_hull(const Polygon &pol, pmr::memory_resource *mr = pmr::get_default_resource()) {
+    return convex_hull(pol.get_vertices(), mr);
+}
+
+// Пересечение выпуклых полигонов по теореме о разделяющей оси: осями служат сохраненные нормали сторон обоих
+// полигонов, полигоны не пересекаются, если на какую-то ось их проекции не перекрываются. Касание считается
+// пересечением. Полигоны из одной или двух вершин (вырожденная оболочка) тоже допускаются
+bool convex_polygons_intersect(const Polygon &first, const Polygon &second) {
+    if (first.size() == 0 || second.size() == 0)
+        return false;
+    auto convex = [](const Polygon &pol) { return pol.size() <= 2 || pol.is_convex(); };
+    if (!convex(first) || !convex(second))
+        throw runtime_error("Expected convex polygons");
+    if (!first.get_bbox().intersects(second.get_bbox()))
+        return false;
+
+    auto projection = [](const Polygon &pol, const Point<int> &axis) {
+        long long lo = LLONG_MAX, hi = LLONG_MIN;
+        for (auto &edge: pol.get_edges()) {
+            long long p = (long long) axis.x * edge.a.x + (long long) axis.y * edge.a.y;
+            lo = min(lo, p);
+            hi = max(hi, p);
+        }
+        return pair(lo, hi);
+    };
+    // знак нормали не важен: у тонких полигонов нормаль, развернутая к округленному центру, может смотреть наружу
+    auto separated = [&](const Polygon &pol) {
+        for (auto &edge: pol.get_edges()) {
+            auto [lo1, hi1] = projection(first, edge.n);
+            auto [lo2, hi2] = projection(second, edge.n);
+            if (hi1 < lo2 || hi2 < lo1)
+                return true;
+        }
+        return false;
+    };
+    return !separated(first) && !separated(second);
+}
+
 // Отсечение произвольного простого полигона по произвольному простому полигону, используя алгоритм Вейлера-Айзертона.
 // При реализации можно сделать несколько упрощений:
 // в случае, когда в результате отсечения образуется несколько полигонов, результатом может служить любой из этих полигонов;
 // вершины исходных полигонов не должны лежать на ребрах друг друга.
-Polygon weiler_atherton(const Polygon &orig, const Polygon &cutter) {
-    vector<Edge> orig_edges = orig.get_edges();
-    vector<Edge> cutter_edges = cutter.get_edges();
-    vector<Point<int>> list1, list2;
+// Временные списки берутся из scratch_arena() текущего потока, результат размещается в mr.
+// mr не может быть scratch_arena(): при выходе арена откатывается и результат был бы затерт следующими вызовами.
+Polygon weiler_atherton(const Polygon &orig, const Polygon &cutter, pmr::memory_resource *mr = pmr::get_default_resource()) {
+    assert(mr != &scratch_arena());
+
+    // разнесенные полигоны отбрасываются до построения списков пересечений
+    if (!orig.get_bbox().intersects(cutter.get_bbox()) ||
+        (orig.is_convex() && cutter.is_convex() && !convex_polygons_intersect(orig, cutter)))
+        return Polygon();
+
+    Arena &arena = scratch_arena();
+    ArenaScope scope(arena);
+
+    const auto &orig_edges = orig.get_edges();
+    const auto &cutter_edges = cutter.get_edges();
+    pmr::vector<Point<int>> list1(&arena), list2(&arena);
     list1.reserve(1.5 * orig_edges.size());
     list2.reserve(1.5 * cutter_edges.size());
 
-    map<Point<int>, size_t> m1, m2;
-    map<pair<int, int>, Intersection> new_points; // храним точки пересечения для отрезков, чтобы избежать магии округления и два раза не считать
+    pmr::map<Point<int>, size_t> m1(&arena), m2(&arena);
+    pmr::map<pair<int, int>, Intersection> new_points(&arena); // храним точки пересечения для отрезков, чтобы избежать магии округления и два раза не считать
+    pmr::vector<pair<double, Point<int>>> intersects(&arena);
 
     for (size_t i = 0; i < orig_edges.size(); i++) {
         auto orig_edge = orig_edges[i];
         list1.push_back(orig_edge.a);
 
-        vector<pair<double, Point<int>>> intersects;
+        intersects.clear();
         for (size_t j = 0; j < cutter_edges.size(); j++) {
             Intersection ans = intersection_point(orig_edge, cutter_edges[j]);
             double t1 = ans.t1, t2 = ans.t2;
@@ -262,7 +846,7 @@ Polygon weiler_atherton(const Polygon &orig, const Polygon &cutter) {
 
     for (size_t j = 0; j < cutter_edges.size(); j++) {
         list2.push_back(cutter_edges[j].a);
-        vector<pair<double, Point<int>>> intersects;
+        intersects.clear();
         for (size_t i = 0; i < orig_edges.size(); i++) {
             if (!new_points.contains({i, j}))
                 continue;
@@ -292,7 +876,8 @@ Polygon weiler_atherton(const Polygon &orig, const Polygon &cutter) {
         return Polygon();
 
     size_t idx1 = (begin + 1) % list1.size();
-    vector<Point<int>> points = {list1[begin]};
+    pmr::vector<Point<int>> points(&arena);
+    points.push_back(list1[begin]);
     while (idx1 != begin) {
         points.push_back(list1[idx1]);
         if (!m1.contains(list1[idx1])) {
@@ -312,5 +897,5 @@ Polygon weiler_atherton(const Polygon &orig, const Polygon &cutter) {
         }
     }
 
-    return Polygon(points);
+    return Polygon(points, mr);
 }
@@ -0,0 +1,323 @@
+#define MAGICKCORE_QUANTUM_DEPTH 16
+#define MAGICKCORE_HDRI_ENABLE 1
+
+#include <atomic>
+#include <charconv>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "polygon.h"
+#include "cube.h"
+#include <Magick++.h>
+
+using namespace std;
+
+// Пакетная отрисовка заданий из файла: graphics_render <файл заданий> [число потоков]
+//
+// Файл читается через mmap и состоит из строк, # начинает комментарий. Задание начинается с image и заканчивается output,
+// цвета задаются байтами 0..255, точки — парами x y:
+//   image <w> <h> [r g b]                   новое изображение с фоном (по умолчанию белым)
+//   color <r> <g> <b> [a]                   цвет следующих команд
+//   blend over|add|multiply                 режим наложения следующих команд
+//   line <x1> <y1> <x2> <y2>
+//   polygon <fill> <n> <точки>              fill: bounds, evenodd, nonzero, triangles, smooth-evenodd, smooth-nonzero
+//   bezier <n> <точки>                      составная кубическая кривая Безье, n = 3k + 1
+//   cube <x> <y> <z> <a> <b> <h> <alpha> <betta> <gamma> [parallel | one <r> | two <p> <q>]
+//   clip <n> <точки> <m> <точки>            границы результата weiler_atherton первого полигона по второму
+//   output <путь>                           запись изображения, конец задания
+//
+// Задания рисуются параллельно, у каждого потока свое изображение, которое переиспользуется между заданиями одного размера.
+
+class MappedFile {
+private:
+    const char *data = nullptr;
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Cannot open " + path);
+        struct stat info{};
+        if (fstat(fd, &info) < 0) {
+            close(fd);
+            throw runtime_error("Cannot stat " + path);
+        }
+        length = info.st_size;
+        if (length > 0) {
+            void *ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) {
+                close(fd);
+                throw runtime_error("Cannot map " + path);
+            }
+            data = static_cast<const char *>(ptr);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    string_view view() const {
+        return {data, length};
+    }
+
+    ~MappedFile() {
+        if (data)
+            munmap(const_cast<char *>(data), length);
+    }
+};
+
+// Разбор одной строки на слова без копирования
+class Tokens {
+private:
+    string_view line;
+    size_t line_number;
+
+public:
+    Tokens(string_view line, size_t line_number) : line(line), line_number(line_number) {}
+
+    bool empty() {
+        size_t begin = line.find_first_not_of(" \t\r");
+        line = begin == string_view::npos ? string_view() : line.substr(begin);
+        return line.empty();
+    }
+
+    [[noreturn]] void fail(const string &message) const {
+        throw runtime_error("line " + to_string(line_number) + ": " + message);
+    }
+
+    string_view word() {
+        if (empty())
+            fail("unexpected end of line");
+        size_t end = line.find_first_of(" \t\r");
+        string_view result = line.substr(0, end);
+        line = end == string_view::npos ? string_view() : line.substr(end);
+        return result;
+    }
+
+    // число оставшихся слов, строка не сдвигается
+    size_t remaining() const {
+        size_t count = 0;
+        for (size_t pos = line.find_first_not_of(" \t\r"); pos != string_view::npos;
+             pos = line.find_first_not_of(" \t\r", line.find_first_of(" \t\r", pos)))
+            count++;
+        return count;
+    }
+
+    // после команды в строке ничего не должно остаться
+    void finish() {
+        if (!empty())
+            fail("unexpected token '" + string(word()) + "'");
+    }
+
+    template<typename T>
+    T number() {
+        string_view w = word();
+        T value{};
+        auto [ptr, ec] = from_chars(w.data(), w.data() + w.size(), value);
+        if (ec != errc() || ptr != w.data() + w.size())
+            fail("expected a number, got '" + string(w) + "'");
+        return value;
+    }
+
+    vector<Point<int>> points() {
+        int n = number<int>();
+        if (n < 0)
+            fail("negative number of points");
+        // число проверяется до выделения памяти: огромное n — ошибка разбора, а не нехватка памяти
+        if (size_t(n) > remaining() / 2)
+            fail("expected " + to_string(n) + " points, got " + to_string(remaining() / 2));
+        vector<Point<int>> result(n);
+        for (auto &p: result) {
+            p.x = number<int>();
+            p.y = number<int>();
+        }
+        return result;
+    }
+
+    Magick::Color color() {
+        double r = number<int>(), g = number<int>(), b = number<int>();
+        double a = empty() ? 255 : number<int>();
+        double k = QuantumRange / 255.0;
+        return Magick::Color(Magick::Quantum(r * k), Magick::Quantum(g * k), Magick::Quantum(b * k),
+                             Magick::Quantum(a * k));
+    }
+};
+
+struct Job {
+    size_t first_line;
+    vector<string_view> lines;
+};
+
+vector<Job> split_jobs(string_view text) {
+    vector<Job> jobs;
+    bool inside = false;
+    size_t line_number = 0;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        string_view line = text.substr(0, end);
+        text = end == string_view::npos ? string_view() : text.substr(end + 1);
+        line_number++;
+
+        line = line.substr(0, line.find('#'));
+        Tokens tokens(line, line_number);
+        if (tokens.empty())
+            continue;
+
+        string_view command = tokens.word();
+        if (command == "image") {
+            if (inside)
+                tokens.fail("image inside an unfinished job");
+            jobs.push_back({line_number, {}});
+            inside = true;
+        } else if (!inside) {
+            tokens.fail("'" + string(command) + "' outside of a job");
+        }
+        jobs.back().lines.push_back(line);
+        if (command == "output")
+            inside = false;
+    }
+    if (inside)
+        throw runtime_error("last job has no output");
+    return jobs;
+}
+
+void render_job(const Job &job, Magick::Image &img) {
+    Magick::Color color(0, 0, 0);
+    BlendMode mode = BlendMode::SourceOver;
+
+    for (size_t i = 0; i < job.lines.size(); i++) {
+        Tokens tokens(job.lines[i], job.first_line + i);
+        tokens.empty();
+        string_view command = tokens.word();
+
+        if (command == "image") {
+            size_t width = tokens.number<size_t>(), height = tokens.number<size_t>();
+            Magick::Color background = tokens.empty() ? Magick::Color(QuantumRange, QuantumRange, QuantumRange) : tokens.color();
+            if (img.columns() != width || img.rows() != height)
+                img = Magick::Image(Magick::Geometry(width, height), background);
+            else {
+                img.backgroundColor(background);
+                img.erase();
+            }
+        } else if (command == "color") {
+            color = tokens.color();
+        } else if (command == "blend") {
+            string_view name = tokens.word();
+            if (name == "over")
+                mode = BlendMode::SourceOver;
+            else if (name == "add")
+                mode = BlendMode::Additive;
+            else if (name == "multiply")
+                mode = BlendMode::Multiply;
+            else
+                tokens.fail("unknown blend mode '" + string(name) + "'");
+        } else if (command == "line") {
+            int x1 = tokens.number<int>(), y1 = tokens.number<int>();
+            int x2 = tokens.number<int>(), y2 = tokens.number<int>();
+            draw_line(x1, y1, x2, y2, img, color, mode);
+        } else if (command == "polygon") {
+            string_view fill = tokens.word();
+            Polygon pol(tokens.points());
+            if (fill == "bounds")
+                pol.draw_bounds(img, color, mode);
+            else if (fill == "evenodd")
+                pol.fill_polygon(Polygon::EvenOddRule, img, color, mode);
+            else if (fill == "nonzero")
+                pol.fill_polygon(Polygon::NonZeroWinding, img, color, mode);
+            else if (fill == "triangles")
+                pol.fill_polygon(Polygon::Triangulation, img, color, mode);
+            else if (fill == "smooth-evenodd")
+                pol.fill_polygon_antialiased(Polygon::EvenOddRule, img, color, mode);
+            else if (fill == "smooth-nonzero")
+                pol.fill_polygon_antialiased(Polygon::NonZeroWinding, img, color, mode);
+            else
+                tokens.fail("unknown fill '" + string(fill) + "'");
+        } else if (command == "bezier") {
+            vector<Point<int>> points = tokens.points();
+            if (points.size() < 4 || points.size() % 3 != 1)
+                tokens.fail("bezier needs 3k + 1 points");
+            draw_composite_bezier_curve_3(points, img, color, mode);
+        } else if (command == "cube") {
+            Point<int> p_min;
+            p_min.x = tokens.number<int>();
+            p_min.y = tokens.number<int>();
+            p_min.z = tokens.number<int>();
+            int a = tokens.number<int>(), b = tokens.number<int>(), h = tokens.number<int>();
+            double alpha = tokens.number<double>(), betta = tokens.number<double>(), gamma = tokens.number<double>();
+            Cube cube(p_min, a, b, h);
+            cube.rotate(alpha, betta, gamma, cube.get_center());
+
+            string_view projection = tokens.empty() ? "parallel" : tokens.word();
+            if (projection == "parallel")
+                cube.draw(img, color, mode);
+            else if (projection == "one")
+                cube.draw_one_point_projection(tokens.number<double>(), img, color, mode);
+            else if (projection == "two") {
+                double p = tokens.number<double>(), q = tokens.number<double>();
+                cube.draw_two_point_projection(p, q, img, color, mode);
+            } else
+                tokens.fail("unknown projection '" + string(projection) + "'");
+        } else if (command == "clip") {
+            Polygon orig(tokens.points());
+            Polygon cutter(tokens.points());
+            weiler_atherton(orig, cutter).draw_bounds(img, color, mode);
+        } else if (command == "output") {
+            string path(tokens.word());
+            tokens.finish();
+            // как в тестах: ось y направлена вверх
+            img.flip();
+            img.write(path);
+        } else {
+            tokens.fail("unknown command '" + string(command) + "'");
+        }
+        tokens.finish();
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <jobs file> [threads]" << endl;
+        return 2;
+    }
+    Magick::InitializeMagick(*argv);
+
+    try {
+        MappedFile file(argv[1]);
+        vector<Job> jobs = split_jobs(file.view());
+
+        unsigned threads = argc > 2 ? unsigned(stoul(argv[2])) : max(1u, thread::hardware_concurrency());
+        threads = unsigned(min<size_t>(max(threads, 1u), max<size_t>(jobs.size(), 1)));
+
+        atomic<size_t> next_job = 0;
+        atomic<bool> failed = false;
+        auto worker = [&]() {
+            Magick::Image img;
+            for (size_t id; !failed && (id = next_job++) < jobs.size();) {
+                try {
+                    render_job(jobs[id], img);
+                } catch (const exception &e) {
+                    cerr << e.what() << endl;
+                    failed = true;
+                }
+            }
+        };
+
+        vector<thread> pool;
+        for (unsigned t = 1; t < threads; t++)
+            pool.emplace_back(worker);
+        worker();
+        for (auto &th: pool)
+            th.join();
+
+        return failed ? 1 : 0;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
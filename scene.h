@@ -0,0 +1,164 @@
+#pragma once
+
+#include "polygon.h"
+
+// Набор полигонов с равномерной сеткой по их BBox.
+// Каждый полигон записан во все ячейки, которые задевает его BBox; полигоны за пределами сетки попадают в крайние ячейки
+class Scene {
+private:
+    vector<Polygon> polygons;
+    vector<BBox> boxes;
+
+    int cell_size = 1;
+    int x0 = 0, y0 = 0;
+    int cols = 1, rows = 1;
+    vector<vector<size_t>> cells = vector<vector<size_t>>(1);
+
+    int cell_x(int x) const {
+        return clamp(int(floor_div(x - x0, cell_size)), 0, cols - 1);
+    }
+
+    int cell_y(int y) const {
+        return clamp(int(floor_div(y - y0, cell_size)), 0, rows - 1);
+    }
+
+    // ячейка, из которой сообщаем о пересечении двух BBox, чтобы не повторять ответ для каждой общей ячейки
+    int owner_cell(const BBox &a, const BBox &b) const {
+        return cell_y(max(a.y_min, b.y_min)) * cols + cell_x(max(a.x_min, b.x_min));
+    }
+
+    template<typename F>
+    void for_cells(const BBox &box, F &&f) const {
+        for (int j = cell_y(box.y_min); j <= cell_y(box.y_max); j++) {
+            for (int i = cell_x(box.x_min); i <= cell_x(box.x_max); i++)
+                f(j * cols + i);
+        }
+    }
+
+    void insert(size_t id) {
+        for_cells(boxes[id], [&](int cell) { cells[cell].push_back(id); });
+    }
+
+    void erase(size_t id) {
+        for_cells(boxes[id], [&](int cell) {
+            auto &ids = cells[cell];
+            auto it = find(ids.begin(), ids.end(), id);
+            *it = ids.back();
+            ids.pop_back();
+        });
+    }
+
+public:
+    Scene() = default;
+
+    explicit Scene(vector<Polygon> polygons) : polygons(std::move(polygons)) {
+        build();
+    }
+
+    // Перестроение сетки по всем полигонам: размер ячейки равен среднему размеру BBox,
+    // но ячеек не больше, чем примерно 4 на полигон
+    void build() {
+        boxes.resize(polygons.size());
+        for (size_t id = 0; id < polygons.size(); id++)
+            boxes[id] = polygons[id].get_bbox();
+
+        cell_size = 1;
+        x0 = y0 = 0;
+        cols = rows = 1;
+        if (!boxes.empty()) {
+            BBox bounds = boxes[0];
+            long long extent = 0;
+            for (auto &box: boxes) {
+                bounds.x_min = min(bounds.x_min, box.x_min);
+                bounds.x_max = max(bounds.x_max, box.x_max);
+                bounds.y_min = min(bounds.y_min, box.y_min);
+                bounds.y_max = max(bounds.y_max, box.y_max);
+                extent += (box.x_max - box.x_min) + (box.y_max - box.y_min);
+            }
+
+            long long width = bounds.x_max - bounds.x_min + 1, height = bounds.y_max - bounds.y_min + 1;
+            long long max_cells = 4 * (long long) boxes.size() + 16;
+            cell_size = max(1, int(extent / (2 * (long long) boxes.size())));
+            while (((width + cell_size - 1) / cell_size) * ((height + cell_size - 1) / cell_size) > max_cells)
+                cell_size *= 2;
+
+            x0 = bounds.x_min;
+            y0 = bounds.y_min;
+            cols = int((width + cell_size - 1) / cell_size);
+            rows = int((height + cell_size - 1) / cell_size);
+        }
+
+        cells.assign(size_t(cols) * rows, {});
+        for (size_t id = 0; id < polygons.size(); id++)
+            insert(id);
+    }
+
+    // Добавление без перестроения сетки, после большого числа добавлений стоит вызвать build()
+    size_t add(Polygon pol) {
+        polygons.push_back(std::move(pol));
+        boxes.push_back(polygons.back().get_bbox());
+        insert(polygons.size() - 1);
+        return polygons.size() - 1;
+    }
+
+    // Сдвиг полигона с обновлением только тех ячеек, которые он покидает или занимает
+    void move(size_t id, const Point<int> &shift) {
+        erase(id);
+        polygons[id].move(shift);
+        boxes[id] = polygons[id].get_bbox();
+        insert(id);
+    }
+
+    const Polygon &operator[](size_t id) const {
+        return polygons[id];
+    }
+
+    size_t size() const {
+        return polygons.size();
+    }
+
+    // Номера полигонов, содержащих точку, по возрастанию
+    vector<size_t> hit_test(const Point<int> &point, Polygon::FillingMethod method = Polygon::EvenOddRule) const {
+        vector<size_t> result;
+        for (size_t id: cells[cell_y(point.y) * cols + cell_x(point.x)]) {
+            if (!boxes[id].contains(point))
+                continue;
+            bool inside = method == Polygon::EvenOddRule ? polygons[id].is_inside_even_odd_rule(point)
+                                                         : polygons[id].is_inside_non_zero_winding(point);
+            if (inside)
+                result.push_back(id);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+    // Номера полигонов, чьи BBox пересекают прямоугольник, по возрастанию
+    vector<size_t> query(const BBox &rect) const {
+        vector<size_t> result;
+        for_cells(rect, [&](int cell) {
+            for (size_t id: cells[cell]) {
+                if (boxes[id].intersects(rect) && owner_cell(boxes[id], rect) == cell)
+                    result.push_back(id);
+            }
+        });
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+    // Пары (i < j) с пересекающимися BBox — кандидаты для weiler_atherton
+    vector<pair<size_t, size_t>> candidate_pairs() const {
+        vector<pair<size_t, size_t>> result;
+        for (int cell = 0; cell < cols * rows; cell++) {
+            auto &ids = cells[cell];
+            for (size_t a = 0; a < ids.size(); a++) {
+                for (size_t b = a + 1; b < ids.size(); b++) {
+                    size_t i = min(ids[a], ids[b]), j = max(ids[a], ids[b]);
+                    if (boxes[i].intersects(boxes[j]) && owner_cell(boxes[i], boxes[j]) == cell)
+                        result.emplace_back(i, j);
+                }
+            }
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+};
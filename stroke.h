@@ -0,0 +1,173 @@
+#pragma once
+
+#include "polygon.h"
+#include <cmath>
+#include <span>
+
+enum class LineJoin {
+    Miter,
+    Round,
+    Bevel,
+};
+
+enum class LineCap {
+    Butt,
+    Round,
+    Square,
+};
+
+struct StrokeStyle {
+    double width = 1;
+    LineJoin join = LineJoin::Miter;
+    LineCap cap = LineCap::Butt;
+    // при отношении длины острия к половине толщины больше miter_limit острый угол срезается как Bevel
+    double miter_limit = 4;
+};
+
+namespace stroke_detail {
+    Point<double> normalized(const Point<double> &a) {
+        return a / sqrt(a.mod2());
+    }
+
+    // нормаль слева от направления d
+    Point<double> left_normal(const Point<double> &d) {
+        return {-d.y, d.x};
+    }
+
+    // дуга радиуса radius вокруг center от направления from с поворотом на angle, без начальной точки
+    void add_arc(vector<Point<double>> &outline, const Point<double> &center, const Point<double> &from,
+                 double angle, double radius) {
+        // шаг выбирается так, чтобы хорда отходила от дуги не больше чем на четверть пикселя
+        double step = radius > 0.25 ? 2 * acos(1 - 0.25 / radius) : M_PI / 2;
+        int parts = max((int) ceil(abs(angle) / step), 1);
+        for (int k = 1; k <= parts; k++) {
+            double phi = angle * k / parts;
+            Point<double> dir(from.x * cos(phi) - from.y * sin(phi), from.x * sin(phi) + from.y * cos(phi));
+            outline.push_back(center + dir * radius);
+        }
+    }
+
+    // соединение в вершине p отрезков с направлениями a и b с левой стороны
+    void add_join(vector<Point<double>> &outline, const Point<double> &p, const Point<double> &a,
+                  const Point<double> &b, double half_width, const StrokeStyle &style) {
+        Point<double> na = left_normal(a), nb = left_normal(b);
+        double cross = a.x * b.y - a.y * b.x, dot = a.x * b.x + a.y * b.y;
+        outline.push_back(p + na * half_width);
+        if (cross > 0) {
+            // внутренняя сторона: петля через саму вершину, закрашиваемая по правилу non-zero
+            outline.push_back(p);
+            outline.push_back(p + nb * half_width);
+            return;
+        }
+        if (cross == 0 && dot > 0)
+            return;
+
+        if (style.join == LineJoin::Round) {
+            add_arc(outline, p, na, cross == 0 ? -M_PI : atan2(cross, dot), half_width);
+            return;
+        }
+        if (style.join == LineJoin::Miter && na * nb > -1) {
+            Point<double> m = normalized(na + nb);
+            double ratio = 1 / (m * na);
+            if (ratio <= style.miter_limit)
+                outline.push_back(p + m * (half_width * ratio));
+        }
+        outline.push_back(p + nb * half_width);
+    }
+
+    // концевая точка p с направлением d, переход с левой стороны на правую
+    void add_cap(vector<Point<double>> &outline, const Point<double> &p, const Point<double> &d,
+                 double half_width, const StrokeStyle &style) {
+        Point<double> n = left_normal(d);
+        switch (style.cap) {
+            case LineCap::Butt:
+                break;
+            case LineCap::Round:
+                add_arc(outline, p, n, -M_PI, half_width);
+                outline.pop_back();
+                break;
+            case LineCap::Square:
+                outline.push_back(p + (n + d) * half_width);
+                outline.push_back(p + (d - n) * half_width);
+                break;
+        }
+    }
+
+    // левая сторона ломаной от начала до конца и торец на последней точке
+    void add_side(vector<Point<double>> &outline, span<const Point<double>> points, bool reversed,
+                  double half_width, const StrokeStyle &style) {
+        size_t n = points.size();
+        auto at = [&](size_t i) { return reversed ? points[n - 1 - i] : points[i]; };
+
+        Point<double> prev = normalized(at(1) - at(0));
+        outline.push_back(at(0) + left_normal(prev) * half_width);
+        for (size_t i = 1; i + 1 < n; i++) {
+            Point<double> cur = normalized(at(i + 1) - at(i));
+            add_join(outline, at(i), prev, cur, half_width, style);
+            prev = cur;
+        }
+        outline.push_back(at(n - 1) + left_normal(prev) * half_width);
+        add_cap(outline, at(n - 1), prev, half_width, style);
+    }
+}
+
+// Контур обводки ломаной толщины style.width: левая сторона с соединениями, торец, правая сторона в обратном
+// порядке и начальный торец. Контур может самопересекаться и заполняется по правилу NonZeroWinding.
+vector<Point<double>> stroke_outline(span<const Point<double>> polyline, const StrokeStyle &style) {
+    vector<Point<double>> points;
+    for (auto &p: polyline) {
+        if (points.empty() || points.back() != p)
+            points.push_back(p);
+    }
+
+    vector<Point<double>> outline;
+    double half_width = style.width / 2;
+    if (points.empty() || !(half_width > 0))
+        return outline;
+
+    if (points.size() == 1) {
+        // у вырожденной ломаной остается только торец
+        Point<double> p = points[0];
+        if (style.cap == LineCap::Round) {
+            stroke_detail::add_arc(outline, p, {1, 0}, -2 * M_PI, half_width);
+        } else if (style.cap == LineCap::Square) {
+            outline = {p + Point<double>(-half_width, -half_width), p + Point<double>(half_width, -half_width),
+                       p + Point<double>(half_width, half_width), p + Point<double>(-half_width, half_width)};
+        }
+        return outline;
+    }
+
+    stroke_detail::add_side(outline, points, false, half_width, style);
+    stroke_detail::add_side(outline, points, true, half_width, style);
+    return outline;
+}
+
+vector<Point<double>> stroke_outline(span<const Point<int>> polyline, const StrokeStyle &style) {
+    vector<Point<double>> points(polyline.size());
+    for (size_t i = 0; i < polyline.size(); i++)
+        points[i] = to_double_point(polyline[i]);
+    return stroke_outline(points, style);
+}
+
+// Толстая ломаная: контур обводки заполняется один раз, каждый пиксель закрашивается ровно один раз
+void draw_stroke(span<const Point<int>> polyline, const StrokeStyle &style, Magick::Image &img,
+                 const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) {
+    fill_scanline(stroke_outline(polyline, style), Polygon::NonZeroWinding, img, color, mode);
+}
+
+void draw_stroke(const Point<int> &a, const Point<int> &b, const StrokeStyle &style, Magick::Image &img,
+                 const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) {
+    array<Point<int>, 2> points = {a, b};
+    draw_stroke(points, style, img, color, mode);
+}
+
+void draw_bezier_stroke_3(const vector<Point<int>> &init_points, const StrokeStyle &style, Magick::Image &img,
+                          const Magick::Color &color, BlendMode mode = BlendMode::SourceOver) {
+    draw_stroke(flatten_bezier_curve_3(init_points), style, img, color, mode);
+}
+
+void draw_composite_bezier_stroke_3(const vector<Point<int>> &init_points, const StrokeStyle &style,
+                                    Magick::Image &img, const Magick::Color &color,
+                                    BlendMode mode = BlendMode::SourceOver) {
+    draw_stroke(flatten_composite_bezier_curve_3(init_points), style, img, color, mode);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Пул потоков, переживающий вызовы: run(count, f) выполняет f(t) для t из [0, count) и ждет завершения,
+// f(0) выполняет вызывающий поток. Недостающие потоки создаются при первом запросе и потом переиспользуются.
+// Одновременные вызовы run выполняются по очереди
+class ThreadPool {
+private:
+    mutex m;
+    condition_variable wake, finished;
+    vector<thread> workers;
+    const function<void(unsigned)> *task = nullptr;
+    unsigned count = 0;
+    unsigned remaining = 0;
+    size_t generation = 0;
+    bool stop = false;
+    mutex run_mutex;
+
+    void loop(unsigned index) {
+        size_t seen = 0;
+        unique_lock lock(m);
+        while (true) {
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop)
+                return;
+            seen = generation;
+            if (index >= count)
+                continue;
+
+            const function<void(unsigned)> *f = task;
+            lock.unlock();
+            (*f)(index);
+            lock.lock();
+            if (--remaining == 0)
+                finished.notify_one();
+        }
+    }
+
+public:
+    ThreadPool() = default;
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void run(unsigned threads, const function<void(unsigned)> &f) {
+        threads = max(threads, 1u);
+        lock_guard run_lock(run_mutex);
+        {
+            lock_guard lock(m);
+            while (workers.size() + 1 < threads)
+                workers.emplace_back(&ThreadPool::loop, this, unsigned(workers.size() + 1));
+            task = &f;
+            count = threads;
+            remaining = threads - 1;
+            generation++;
+        }
+        wake.notify_all();
+
+        f(0);
+
+        unique_lock lock(m);
+        finished.wait(lock, [&] { return remaining == 0; });
+    }
+
+    // Общий пул процесса
+    static ThreadPool &shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard lock(m);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &worker: workers)
+            worker.join();
+    }
+};